@@ -1,8 +1,11 @@
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
 #include <time.h>
 #include <cmath>
+#include "wordsearch.h"
 
 #define SIZE_STEP 16
 
@@ -15,11 +18,25 @@
 
 #define EMPTY ' '
 
-/// shuffle array
-void shuffle(int *array, int n){
+/// number of iterations between checkpoints, when a checkpoint file is given
+#define CHECKPOINT_INTERVAL 1000
+
+/// line directions that placers place along. Placers of the opposite
+/// directions place the reversed word along these
+#define PLACER_HORIZONTAL 0
+#define PLACER_VERTICAL 1
+#define PLACER_DIAGONAL_DR 2
+#define PLACER_DIAGONAL_DL 3
+#define PLACER_DIRECTIONS 4
+
+/// first bytes of a checkpoint file
+const char CHECKPOINT_MAGIC[8] = {'G', 'G', 'C', 'K', 'P', 'T', '1', 0};
+
+/// shuffle array, using (and advancing) a rand_r state
+void shuffle(int *array, int n, unsigned int &state){
 	for (int i = 0; i < n; i ++){
 		for (int j = 1; j < n; j ++){
-			if (rand() % 2){
+			if (rand_r(&state) % 2){
 				const int temp = array[i];
 				array[i] = array[j];
 				array[j] = temp;
@@ -28,14 +45,6 @@ void shuffle(int *array, int n){
 	}
 }
 
-/// Length of string
-int length(const char *str){
-	int l = 0;
-	while (str[l])
-		l ++;
-	return l;
-}
-
 /// Makes a new copy of string
 /// Returns: new string
 char *stringCopy(const char* str){
@@ -47,45 +56,9 @@ char *stringCopy(const char* str){
 	return ret;
 }
 
-/// Reverses a string, into a new one
-/// Returns: new string
-char *stringReverseNew(const char *str){
-	const int lastIndex = length(str) - 1;
-	char *ret = new char[lastIndex + 2];
-	int i = 0;
-	while (i <= lastIndex){
-		ret[i] = str[lastIndex - i];
-		i ++;
-	}
-	ret[lastIndex + 1] = 0;
-	return ret;
-}
-
-/// sanitizes word (makes it uppercase, removes non alphabets)
-void sanitize(char* str){
-	if (str == nullptr)
-		return;
-	int len = length(str);
-	// first make it all uppercase
-	for (int i = 0; i < len; i ++){
-		if (str[i] >= 'a' && str[i] <= 'z')
-			str[i] -= 32;
-	}
-	// now remove non alphabets
-	int i = 0, shift = 0;
-	while (i + shift < len){
-		if (str[i + shift] >= 'A' && str[i + shift] <= 'Z'){
-			str[i] = str[i + shift];
-			i ++;
-		}else{
-			shift ++;
-		}
-	}
-	str[i] = 0;
-}
-
-char getRandomAlphabet(){
-	return (rand() % 26) + 'A';
+/// Returns: random letter, using (and advancing) a rand_r state
+char getRandomAlphabet(unsigned int &state){
+	return (rand_r(&state) % 26) + 'A';
 }
 
 /// a linked list based stack  
@@ -165,48 +138,82 @@ public:
 };
 
 /// for storing words, in descending order of length
+///
+/// For the generator's search, buildTable() lays the words out as a table of
+/// arrays: letters and reversed letters of all words in one arena, lengths,
+/// and the max start address in each placer direction.
+/// Reading from it needs no string allocation or length scans
 class WordList{
 private:
 	char **_words;
+	/// length of each word
+	int *_lengths;
 	int _capacity;
 	int _count;
+
+	/// letters of each word, followed by its reversed letters, each null
+	/// terminated. Word i starts at _offsets[i]
+	char *_arena;
+	int *_offsets;
+	/// max address word i can start at, in a grid of the table's length,
+	/// for each direction, at i * PLACER_DIRECTIONS
+	int *_maxStart;
+
 	/// increases capacity of array
 	void _increaseSize(){
 		char **newList = new char*[_capacity + SIZE_STEP];
-		for (int i = 0; i < _capacity; i ++)
+		int *newLengths = new int[_capacity + SIZE_STEP];
+		for (int i = 0; i < _capacity; i ++){
 			newList[i] = _words[i];
+			newLengths[i] = _lengths[i];
+		}
 		for (int i = 0; i < SIZE_STEP; i ++)
 			newList[_capacity + i] = nullptr;
 		_capacity += SIZE_STEP;
 		delete[] _words;
+		delete[] _lengths;
 		_words = newList;
+		_lengths = newLengths;
+	}
+	/// frees the word table
+	void _freeTable(){
+		delete[] _arena;
+		delete[] _offsets;
+		delete[] _maxStart;
+		_arena = nullptr;
+		_offsets = _maxStart = nullptr;
 	}
 public:
 	/// constructor
 	WordList(){
 		_words = nullptr;
+		_lengths = nullptr;
 		_count = 0;
 		_capacity = 0;
+		_arena = nullptr;
+		_offsets = _maxStart = nullptr;
 	}
 	/// constructor, read words from newline-separated file
-	WordList(const char *filename){
-		_words = nullptr;
-		_count = 0;
-		_capacity = 0;
+	WordList(const char *filename) : WordList(){
 		fromFile(filename);
 	}
-	/// copy constructor
-	WordList(const WordList& from){
+	/// copy constructor. The word table is not copied
+	WordList(const WordList& from) : WordList(){
 		_capacity = from._count;
 		_count = from._count;
 		_words = new char*[_count];
-		for (int i = 0; i < _count; i ++)
+		_lengths = new int[_count];
+		for (int i = 0; i < _count; i ++){
 			_words[i] = stringCopy(from._words[i]);
+			_lengths[i] = from._lengths[i];
+		}
 	}
 	~WordList(){
 		for (int i = 0; i < _count; i ++)
 			delete[] _words[i];
 		delete[] _words;
+		delete[] _lengths;
+		_freeTable();
 	}
 	/// Returns: number of words
 	int count(){
@@ -222,6 +229,58 @@ public:
 	char *operator[](int index){
 		return get(index);
 	}
+	/// Returns: length of word at index
+	int wordLength(int index){
+		return _lengths[index];
+	}
+	/// Returns: letters of word at index, from the word table
+	const char *letters(int index){
+		return _arena + _offsets[index];
+	}
+	/// Returns: reversed letters of word at index, from the word table
+	const char *reversed(int index){
+		return _arena + _offsets[index] + _lengths[index] + 1;
+	}
+	/// Returns: max address word at index can start at in direction (one of
+	/// PLACER_*), from the word table. Negative if it fits nowhere
+	int maxStart(int index, int direction){
+		return _maxStart[index * PLACER_DIRECTIONS + direction];
+	}
+	/// builds the word table, for a grid of gridLen x gridLen. Must be
+	/// called again after words are added, or for a different length.
+	///
+	/// Start addresses are limited by the row a word must fit above; a
+	/// horizontal word must also fit in the last row. Columns are still for
+	/// the placer to check
+	void buildTable(int gridLen){
+		_freeTable();
+		long long arenaLen = 0;
+		for (int i = 0; i < _count; i ++)
+			arenaLen += 2 * (_lengths[i] + 1);
+		_arena = new char[arenaLen];
+		_offsets = new int[_count];
+		_maxStart = new int[_count * PLACER_DIRECTIONS];
+		int offset = 0;
+		for (int i = 0; i < _count; i ++){
+			const int len = _lengths[i];
+			char *forward = _arena + offset, *backward = forward + len + 1;
+			for (int j = 0; j < len; j ++){
+				forward[j] = _words[i][j];
+				backward[j] = _words[i][len - 1 - j];
+			}
+			forward[len] = backward[len] = 0;
+			_offsets[i] = offset;
+			offset += 2 * (len + 1);
+
+			// last row a word can start at, going down, is gridLen - len - 1
+			const int lastDown = (gridLen - len) * gridLen - 1;
+			int *maxStart = _maxStart + i * PLACER_DIRECTIONS;
+			maxStart[PLACER_HORIZONTAL] = gridLen * gridLen - len - 1;
+			maxStart[PLACER_VERTICAL] = lastDown;
+			maxStart[PLACER_DIAGONAL_DR] = lastDown;
+			maxStart[PLACER_DIAGONAL_DL] = lastDown;
+		}
+	}
 	/// Adds a new word, while keeping the order
 	void add(char *word){
 		if (word == nullptr || length(word) == 0)
@@ -229,28 +288,27 @@ public:
 		int len = length(word);
 		// find insertion index
 		int index = 0;
-		while (index < _count && length(_words[index]) >= len)
+		while (index < _count && _lengths[index] >= len)
 			index ++;
 		if (_count == _capacity)
 			_increaseSize();
-		if (index == _count){
-			_words[_count ++] = word;
-			return;
-		}
 		// shift
-		for (int i = _count; i > index; i --)
+		for (int i = _count; i > index; i --){
 			_words[i] = _words[i - 1];
+			_lengths[i] = _lengths[i - 1];
+		}
 		// place
 		_words[index] = word;
+		_lengths[index] = len;
 		_count ++;
 	}
 	/// add words from newline-separated file
-	void fromFile(const char *filename){
+	/// Returns: true if done, false if file could not be opened
+	bool fromFile(const char *filename){
 		std::ifstream file(filename);
 		if (!file){
-			std::cerr << "Failed to open file\nbyebye\n";
-			exit(1);
-			return;
+			errors() << "Failed to open file " << filename << '\n';
+			return false;
 		}
 		char buffer[100];
 		while (!file.eof()){
@@ -259,6 +317,7 @@ public:
 			add(stringCopy(buffer));
 		}
 		file.close();
+		return true;
 	}
 };
 
@@ -309,13 +368,13 @@ public:
 		if (_grid != nullptr)
 			delete[] _grid;
 	}
-	/// fills empty cells with random alphabets.
+	/// fills empty cells with random alphabets, from a rand_r state.
 	/// Locks the grid from further changes
-	void finalize(){
+	void finalize(unsigned int &rngState){
 		charCount();
 		for (int addr = 0; addr < _gridSize; addr ++)
 			if (_grid[addr] == EMPTY)
-				_grid[addr] = getRandomAlphabet();
+				_grid[addr] = getRandomAlphabet(rngState);
 	}
 	int linAddr(int x, int y){
 		return x + (y * _len);
@@ -345,7 +404,7 @@ public:
 	/// Returns: cell
 	char &cell(int addr){
 		if (addr < 0 || addr >= _gridSize){
-			std::cerr << "out of bound access detected " << addr << '\n';
+			errors() << "out of bound access detected " << addr << '\n';
 			return _dummy;
 		}
 		if (_locked){
@@ -402,7 +461,7 @@ public:
 	bool toFile(const char *filename){
 		std::ofstream file(filename);
 		if (!file){
-			std::cerr << "Failed to open file " << filename << '\n';
+			errors() << "Failed to open file " << filename << '\n';
 			return false;
 		}
 		for (int addr = 0; addr < _gridSize; addr ++){
@@ -422,9 +481,10 @@ public:
 /// * grid
 /// * history stack (should push each address it alters on grid), and at end
 ///		should push the number of alterations done
-/// * CString of the word to place
+/// * word list, with its word table built for the grid's length
+/// * index of the word to place
 /// * address to place at
-typedef bool (*WordPlacerFunc)(Grid*, StackInt*, char*, char*, int);
+typedef bool (*WordPlacerFunc)(Grid*, StackInt*, WordList*, int, int);
 
 // Grid generator
 class GridGen{
@@ -464,10 +524,31 @@ private:
 	/// number of grids that were generated
 	int _bestGridCandidates;
 
+	/// state of the random number generator (rand_r)
+	unsigned int _rngState;
+
+	/// index in _addrOrder, and in _placersOrder, of the placement of the
+	/// word at each depth, for depths currently placed
+	int *_pathAddr;
+	int *_pathPlacer;
+
+	/// file checkpoints are written to, nullptr for none
+	char *_checkpointFile;
+	/// iterations between checkpoints
+	int _checkpointInterval;
+
+	/// depth at which a loaded checkpoint resumes, -1 if not resuming.
+	/// Depths before it replay their placement from _pathAddr/_pathPlacer
+	int _resumeDepth;
+	/// index in _addrOrder that the resume depth continues from
+	int _resumeAddr;
+	/// placer counts and candidates at time of the checkpoint
+	int *_resumeWCount;
+	int _resumeCandidates;
+
 	/// Randomizes placers and addresses orders.
 	/// _grid must exist before this
 	void _randomize(){
-		srand(time(nullptr));
 		if (_placersOrder)
 			delete[] _placersOrder;
 		if (_addrOrder)
@@ -481,8 +562,96 @@ private:
 		for (int i = 0; i < _grid->size(); i ++)
 			_addrOrder[i] = i;
 
-		shuffle(_placersOrder, _placersCount);
-		shuffle(_addrOrder, gridSize);
+		shuffle(_placersOrder, _placersCount, _rngState);
+		shuffle(_addrOrder, gridSize, _rngState);
+	}
+
+	/// Returns: hash of the words list, to tell if a checkpoint is of it
+	unsigned int _wordsHash(){
+		unsigned int hash = 2166136261u;
+		for (int i = 0; i < _words->count(); i ++){
+			for (const char *c = _words->get(i); *c; c ++)
+				hash = (hash ^ (unsigned char)*c) * 16777619u;
+			hash = (hash ^ '\n') * 16777619u;
+		}
+		return hash;
+	}
+
+	static void _writeInts(std::ofstream &file, const int *values, int count){
+		file.write((const char*)values, sizeof(int) * count);
+	}
+	static bool _readInts(std::ifstream &file, int *values, int count){
+		file.read((char*)values, sizeof(int) * count);
+		return file.gcount() == (std::streamsize)(sizeof(int) * count);
+	}
+	/// Returns: true if all count values are in [0, limit)
+	static bool _allBelow(const int *values, int count, int limit){
+		for (int i = 0; i < count; i ++){
+			if (values[i] < 0 || values[i] >= limit)
+				return false;
+		}
+		return true;
+	}
+
+	/// writes a checkpoint of the search, at depth, which will continue from
+	/// index nextAddr in _addrOrder. Written to a temporary file first, and
+	/// renamed over the old checkpoint, so one is always whole.
+	///
+	/// Returns: true if done, false if errored (reason written to stderr)
+	bool _writeCheckpoint(int depth, int nextAddr){
+		const int nameLen = length(_checkpointFile);
+		char *tmpFile = new char[nameLen + 5];
+		for (int i = 0; i < nameLen; i ++)
+			tmpFile[i] = _checkpointFile[i];
+		tmpFile[nameLen] = '.';
+		tmpFile[nameLen + 1] = 't';
+		tmpFile[nameLen + 2] = 'm';
+		tmpFile[nameLen + 3] = 'p';
+		tmpFile[nameLen + 4] = 0;
+		std::ofstream file(tmpFile, std::ios::binary);
+		if (!file){
+			errors() << "Failed to open file " << tmpFile << '\n';
+			delete[] tmpFile;
+			return false;
+		}
+		const int gridSize = _grid->size();
+		const int header[] = {_gridLen, _words->count(), _placersCount,
+			(int)_wordsHash(), (int)_rngState, _iterations, _bestGridCandidates,
+			depth, nextAddr, _bestGrid != nullptr, _bestGridScore};
+		file.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+		_writeInts(file, header, sizeof(header) / sizeof(int));
+		_writeInts(file, _placersOrder, _placersCount);
+		_writeInts(file, _addrOrder, gridSize);
+		_writeInts(file, _pathAddr, depth);
+		_writeInts(file, _pathPlacer, depth);
+		_writeInts(file, _placerWCount, _placersCount);
+		for (int addr = 0; _bestGrid && addr < gridSize; addr ++)
+			file << _bestGrid->cell(addr);
+		file.close();
+		if (!file || rename(tmpFile, _checkpointFile) != 0){
+			errors() << "Failed to write checkpoint " << _checkpointFile << '\n';
+			delete[] tmpFile;
+			return false;
+		}
+		delete[] tmpFile;
+		return true;
+	}
+
+	/// called on reaching the depth a checkpoint resumes at, once earlier
+	/// depths have replayed their placements. Restores counters that replay
+	/// does not
+	void _resumed(){
+		for (int i = 0; i < _placersCount; i ++){
+			if (_placerWCount[i] != _resumeWCount[i]){
+				errors() << "Checkpoint placements did not replay, placers "
+					"differ from checkpoint's. Continuing from here\n";
+				break;
+			}
+		}
+		_bestGridCandidates = _resumeCandidates;
+		_resumeDepth = -1;
+		delete[] _resumeWCount;
+		_resumeWCount = nullptr;
 	}
 
 	int _getScore(){
@@ -499,17 +668,27 @@ private:
 
 	/// generates
 	bool _generate(int wordInd){
-		char *word = _words->get(wordInd);
-		char *wordRev = stringReverseNew(word);
 		const bool isLastWord = wordInd + 1 == _words->count();
 		const int addrEnd = _grid->size();
-		for (int addrI = 0; addrI < addrEnd; addrI ++){
+		// when resuming, continue from where the checkpoint was at this depth
+		int addrStart = 0, placerStart = 0;
+		if (_resumeDepth > wordInd){
+			addrStart = _pathAddr[wordInd];
+			placerStart = _pathPlacer[wordInd];
+		}else if (_resumeDepth == wordInd){
+			addrStart = _resumeAddr;
+			_resumed();
+		}
+		for (int addrI = addrStart; addrI < addrEnd; addrI ++){
 			const int addr = _addrOrder[addrI];
-			for (int placerI = 0; placerI < _placersCount; placerI ++){
+			for (int placerI = addrI == addrStart ? placerStart : 0;
+					placerI < _placersCount; placerI ++){
 				const int placer = _placersOrder[placerI];
 				// try the placer on every cell
-				if (_placers[placer](_grid, _history, word, wordRev, addr)){
+				if (_placers[placer](_grid, _history, _words, wordInd, addr)){
 					_placerWCount[placer] ++;
+					_pathAddr[wordInd] = addrI;
+					_pathPlacer[wordInd] = placerI;
 					_bestGridCandidates ++;
 					if (isLastWord){
 						const int thisScore = _getScore();
@@ -529,18 +708,17 @@ private:
 				}
 				// if this placer didnt do anything, try next one
 			}
-			if (++_iterations > _maxIterations && _bestGrid){
-				delete[] wordRev;
+			if (++_iterations > _maxIterations && _bestGrid)
 				return true;
-			}
+			if (_checkpointFile && _iterations % _checkpointInterval == 0)
+				_writeCheckpoint(wordInd, addrI + 1);
 		}
-		delete[] wordRev;
 		return _bestGrid != nullptr;
 	}
 public:
 	GridGen(WordList *words, int maxIter = MAX_ITERATIONS){
 		if (words == nullptr || words->count() == 0){
-			std::cerr << "you passed bad words.\n"
+			errors() << "you passed bad words.\n"
 				<< "prepare for some s e g f a u l t s\n";
 		}
 		_maxIterations = maxIter;
@@ -554,6 +732,13 @@ public:
 		_bestGrid = nullptr;
 		_placersOrder = nullptr;
 		_addrOrder = nullptr;
+		_rngState = time(nullptr);
+		_pathAddr = nullptr;
+		_pathPlacer = nullptr;
+		_checkpointFile = nullptr;
+		_checkpointInterval = CHECKPOINT_INTERVAL;
+		_resumeDepth = -1;
+		_resumeWCount = nullptr;
 		gridLen();
 	}
 	~GridGen(){
@@ -562,30 +747,45 @@ public:
 		if (_bestGrid != nullptr)
 			delete _bestGrid;
 		if (_placersOrder != nullptr)
-			delete _placersOrder;
+			delete[] _placersOrder;
 		if (_addrOrder != nullptr)
-			delete _addrOrder;
+			delete[] _addrOrder;
+		delete[] _pathAddr;
+		delete[] _pathPlacer;
+		delete[] _checkpointFile;
+		delete[] _resumeWCount;
 	}
 	/// attempts to generate the best possible grid
 	/// 
 	/// Returns: true if a grid was generated
+	/// If a checkpoint was loaded, the search continues from it instead.
 	bool generate(){
+		_words->buildTable(_gridLen);
 		_grid = new Grid(_gridLen);
 		_history = new StackInt;
 		_placerWCount = new int[_placersCount];
 		for (int i = 0; i < _placersCount; i ++)
 			_placerWCount[i] = 0;
+		if (_resumeDepth == -1){
+			delete[] _pathAddr;
+			delete[] _pathPlacer;
+			_pathAddr = new int[_words->count()];
+			_pathPlacer = new int[_words->count()];
 
-		if (_bestGrid)
-			delete _bestGrid;
-		_bestGrid = nullptr;
-		_bestGridScore = 0;
-		_iterations = 0;
-		_bestGridCandidates = 0;
+			if (_bestGrid)
+				delete _bestGrid;
+			_bestGrid = nullptr;
+			_bestGridScore = 0;
+			_iterations = 0;
+			_bestGridCandidates = 0;
 
-		_randomize();
+			_randomize();
+		}
 
 		bool found = _generate(0);
+		// the search is over, so there is nothing left to resume
+		if (_checkpointFile)
+			remove(_checkpointFile);
 
 		delete _grid;
 		delete _history;
@@ -598,6 +798,125 @@ public:
 			_gridLen = _gridLen * SIZE_MULTIPLIER;
 		return found;
 	}
+	/// makes generate() write a checkpoint to filename every interval
+	/// iterations, while it searches, and remove it once the search is
+	/// over. nullptr to stop checkpoints
+	void setCheckpoint(const char *filename, int interval = CHECKPOINT_INTERVAL){
+		delete[] _checkpointFile;
+		_checkpointFile = filename ? stringCopy(filename) : nullptr;
+		_checkpointInterval = interval > 0 ? interval : CHECKPOINT_INTERVAL;
+	}
+	/// sets seed of the random number generator, used by generate()
+	void setSeed(unsigned int seed){
+		_rngState = seed;
+	}
+	/// Returns: state of the random number generator, to continue its
+	/// sequence (e.g. in Grid::finalize)
+	unsigned int &rngState(){
+		return _rngState;
+	}
+	/// loads a checkpoint written by generate(), so the next generate()
+	/// continues that search exactly where it was. Placers must be added,
+	/// in the same order, before generate() is called.
+	///
+	/// Returns: true if loaded, false if errored or not a checkpoint of
+	/// these words (reason written to stderr)
+	bool loadCheckpoint(const char *filename){
+		std::ifstream file(filename, std::ios::binary);
+		if (!file){
+			errors() << "Failed to open file " << filename << '\n';
+			return false;
+		}
+		char magic[sizeof(CHECKPOINT_MAGIC)];
+		int header[11];
+		file.read(magic, sizeof(magic));
+		bool valid = file.gcount() == sizeof(magic) &&
+			_readInts(file, header, 11);
+		for (int i = 0; valid && i < (int)sizeof(magic); i ++)
+			valid = magic[i] == CHECKPOINT_MAGIC[i];
+		const int gridLen = header[0], depth = header[7];
+		valid = valid && gridLen > 0 && gridLen <= INT_MAX / gridLen;
+		const int gridSize = valid ? gridLen * gridLen : 0;
+		valid = valid && header[1] == _words->count() &&
+			header[2] == _placersCount && (unsigned int)header[3] == _wordsHash() &&
+			depth >= 0 && depth < _words->count() &&
+			header[8] >= 0 && header[8] <= gridSize;
+		if (!valid){
+			errors() << "Not a checkpoint of these words and placers: "
+				<< filename << '\n';
+			return false;
+		}
+		// a bad header must not make us allocate more than the file holds
+		const std::streampos at = file.tellg();
+		file.seekg(0, std::ios::end);
+		const long long left = file.tellg() - at;
+		file.seekg(at);
+		if (left < (long long)sizeof(int) * (2 * _placersCount + gridSize + 2 * depth) +
+				(header[9] ? gridSize : 0)){
+			errors() << "Checkpoint is truncated: " << filename << '\n';
+			return false;
+		}
+		int *placersOrder = new int[_placersCount];
+		int *addrOrder = new int[gridSize];
+		int *pathAddr = new int[_words->count()];
+		int *pathPlacer = new int[_words->count()];
+		int *wCount = new int[_placersCount];
+		char *best = new char[gridSize];
+		valid = _readInts(file, placersOrder, _placersCount) &&
+			_readInts(file, addrOrder, gridSize) &&
+			_readInts(file, pathAddr, depth) &&
+			_readInts(file, pathPlacer, depth) &&
+			_readInts(file, wCount, _placersCount);
+		if (valid && header[9]){
+			file.read(best, gridSize);
+			valid = file.gcount() == gridSize;
+		}
+		if (!valid){
+			errors() << "Checkpoint is truncated: " << filename << '\n';
+		}else if (!_allBelow(placersOrder, _placersCount, _placersCount) ||
+				!_allBelow(addrOrder, gridSize, gridSize) ||
+				!_allBelow(pathAddr, depth, gridSize) ||
+				!_allBelow(pathPlacer, depth, _placersCount)){
+			errors() << "Checkpoint holds orders out of range: " << filename << '\n';
+			valid = false;
+		}
+		if (!valid){
+			delete[] placersOrder;
+			delete[] addrOrder;
+			delete[] pathAddr;
+			delete[] pathPlacer;
+			delete[] wCount;
+			delete[] best;
+			return false;
+		}
+		_gridLen = gridLen;
+		_rngState = header[4];
+		_iterations = header[5];
+		_resumeCandidates = header[6];
+		_resumeDepth = depth;
+		_resumeAddr = header[8];
+		_bestGridScore = header[10];
+		delete[] _placersOrder;
+		delete[] _addrOrder;
+		delete[] _pathAddr;
+		delete[] _pathPlacer;
+		delete[] _resumeWCount;
+		_placersOrder = placersOrder;
+		_addrOrder = addrOrder;
+		_pathAddr = pathAddr;
+		_pathPlacer = pathPlacer;
+		_resumeWCount = wCount;
+		if (_bestGrid)
+			delete _bestGrid;
+		_bestGrid = nullptr;
+		if (header[9]){
+			_bestGrid = new Grid(gridLen);
+			for (int addr = 0; addr < gridSize; addr ++)
+				_bestGrid->cell(addr) = best[addr];
+		}
+		delete[] best;
+		return true;
+	}
 	/// Returns: best grid or nullptr
 	Grid *bestGrid(){
 		return _bestGrid;
@@ -628,23 +947,25 @@ public:
 		// count the number of chars needed in square
 		_charCount = 0;
 		for (int i = 0; i < _words->count(); i++)
-			_charCount += length(_words->get(i));
+			_charCount += _words->wordLength(i);
 		// now need a square big enough to hold all these.
 		float idealLen = sqrt(_charCount);
-		if (idealLen < length(_words->get(0)))
-			_gridLen =  length(_words->get(0)) * SIZE_MULTIPLIER;
+		if (idealLen < _words->wordLength(0))
+			_gridLen =  _words->wordLength(0) * SIZE_MULTIPLIER;
 		else
 			_gridLen = idealLen * SIZE_MULTIPLIER;
 		return _gridLen;
 	}
 };
 
-bool placerHorizontalL2R(Grid *grid, StackInt *history, char *word, char *rev, int addr){
-	int len = length(word);
+/// places letters (len of them) horizontally at addr, if they fit.
+/// maxStart is the word table's max start address for this direction
+bool placeHorizontal(Grid *grid, StackInt *history, const char *word, int len,
+		int maxStart, int addr){
 	bool ret = true;
 	int x, y;
 	grid->linAddr(addr, x, y);
-	if (x + len >= grid->length())
+	if (addr > maxStart || x + len >= grid->length())
 		return false;
 	for (int i = 0; ret && i < len && x < grid->length(); x ++, i ++)
 		ret = grid->isEmpty(x, y) || grid->cell(x, y) == word[i];
@@ -664,17 +985,25 @@ bool placerHorizontalL2R(Grid *grid, StackInt *history, char *word, char *rev, i
 	return true;
 }
 
-bool placeHorizontalR2L(Grid *grid, StackInt *history, char *word, char *rev, int addr){
-	return  placerHorizontalL2R(grid, history, rev, rev, addr);
+bool placerHorizontalL2R(Grid *grid, StackInt *history, WordList *words, int word, int addr){
+	return placeHorizontal(grid, history, words->letters(word), words->wordLength(word),
+			words->maxStart(word, PLACER_HORIZONTAL), addr);
+}
+
+bool placeHorizontalR2L(Grid *grid, StackInt *history, WordList *words, int word, int addr){
+	return placeHorizontal(grid, history, words->reversed(word), words->wordLength(word),
+			words->maxStart(word, PLACER_HORIZONTAL), addr);
 }
 
-bool placerVerticalU2D(Grid *grid, StackInt *history, char *word, char *rev, int addr){
-	int len = length(word);
+/// places letters (len of them) vertically at addr, if they fit.
+/// maxStart is the word table's max start address for this direction
+bool placeVertical(Grid *grid, StackInt *history, const char *word, int len,
+		int maxStart, int addr){
 	bool ret = true;
 	int x, y;
-	grid->linAddr(addr, x, y);
-	if (y + len >= grid->length())
+	if (addr > maxStart)
 		return false;
+	grid->linAddr(addr, x, y);
 	for (int i = 0; ret && i < len && y < grid->length(); y ++, i ++)
 		ret = grid->isEmpty(x, y) || grid->cell(x, y) == word[i];
 	if (!ret)
@@ -693,16 +1022,25 @@ bool placerVerticalU2D(Grid *grid, StackInt *history, char *word, char *rev, int
 	return true;
 }
 
-bool placerVerticalD2U(Grid *grid, StackInt *history, char *word, char *rev, int addr){
-	return placerVerticalU2D(grid, history, rev, rev, addr);
+bool placerVerticalU2D(Grid *grid, StackInt *history, WordList *words, int word, int addr){
+	return placeVertical(grid, history, words->letters(word), words->wordLength(word),
+			words->maxStart(word, PLACER_VERTICAL), addr);
+}
+
+bool placerVerticalD2U(Grid *grid, StackInt *history, WordList *words, int word, int addr){
+	return placeVertical(grid, history, words->reversed(word), words->wordLength(word),
+			words->maxStart(word, PLACER_VERTICAL), addr);
 }
 
-bool placerDiagonalUL2DR(Grid *grid, StackInt *history, char *word, char *rev, int addr){
-	int len = length(word);
+/// places letters (len of them) diagonally, down and right, at addr, if
+/// they fit. maxStart is the word table's max start address for this
+/// direction
+bool placeDiagonalDR(Grid *grid, StackInt *history, const char *word, int len,
+		int maxStart, int addr){
 	bool ret = true;
 	int x, y;
 	grid->linAddr(addr, x, y);
-	if (y + len >= grid->length() || x + len >= grid->length())
+	if (addr > maxStart || x + len >= grid->length())
 		return false;
 	for (int i = 0; ret && i < len && x < grid->length() && y < grid->length(); x ++, y ++, i ++)
 		ret = grid->isEmpty(x, y) || grid->cell(x, y) == word[i];
@@ -722,16 +1060,25 @@ bool placerDiagonalUL2DR(Grid *grid, StackInt *history, char *word, char *rev, i
 	return true;
 }
 
-bool placerDiagonalDR2UL(Grid *grid, StackInt *history, char *word, char *rev, int addr){
-	return placerDiagonalUL2DR(grid, history, rev, rev, addr);
+bool placerDiagonalUL2DR(Grid *grid, StackInt *history, WordList *words, int word, int addr){
+	return placeDiagonalDR(grid, history, words->letters(word), words->wordLength(word),
+			words->maxStart(word, PLACER_DIAGONAL_DR), addr);
+}
+
+bool placerDiagonalDR2UL(Grid *grid, StackInt *history, WordList *words, int word, int addr){
+	return placeDiagonalDR(grid, history, words->reversed(word), words->wordLength(word),
+			words->maxStart(word, PLACER_DIAGONAL_DR), addr);
 }
 
-bool placerDiagonalUR2DL(Grid *grid, StackInt *history, char *word, char *rev, int addr){
-	int len = length(word);
+/// places letters (len of them) diagonally, down and left, at addr, if
+/// they fit. maxStart is the word table's max start address for this
+/// direction
+bool placeDiagonalDL(Grid *grid, StackInt *history, const char *word, int len,
+		int maxStart, int addr){
 	bool ret = true;
 	int x, y;
 	grid->linAddr(addr, x, y);
-	if (y + len >= grid->length() || x < len + 1)
+	if (addr > maxStart || x < len + 1)
 		return false;
 	for (int i = 0; ret && i < len && x > 0 && y < grid->length(); x --, y ++, i ++)
 		ret = grid->isEmpty(x, y) || grid->cell(x, y) == word[i];
@@ -751,19 +1098,18 @@ bool placerDiagonalUR2DL(Grid *grid, StackInt *history, char *word, char *rev, i
 	return true;
 }
 
-bool placerDiagonalDL2UR(Grid *grid, StackInt *history, char *word, char *rev, int addr){
-	return placerDiagonalUR2DL(grid, history, rev, rev, addr);
+bool placerDiagonalUR2DL(Grid *grid, StackInt *history, WordList *words, int word, int addr){
+	return placeDiagonalDL(grid, history, words->letters(word), words->wordLength(word),
+			words->maxStart(word, PLACER_DIAGONAL_DL), addr);
 }
 
-int main(int argc, char **argv){
-	const char *filename = "input.txt", *outFilename = "output.txt";
-	if (argc >= 1)
-		filename = argv[1];
-	if (argc >= 2)
-		outFilename = argv[2];
-	srand(time(nullptr));
-	WordList *words = new WordList(filename);
-	GridGen generator(words);
+bool placerDiagonalDL2UR(Grid *grid, StackInt *history, WordList *words, int word, int addr){
+	return placeDiagonalDL(grid, history, words->reversed(word), words->wordLength(word),
+			words->maxStart(word, PLACER_DIAGONAL_DL), addr);
+}
+
+/// adds all placers to a generator, in the order main always used
+void addDefaultPlacers(GridGen &generator){
 	generator.addPlacer(placerHorizontalL2R);
 	generator.addPlacer(placeHorizontalR2L);
 	generator.addPlacer(placerVerticalU2D);
@@ -772,10 +1118,71 @@ int main(int argc, char **argv){
 	generator.addPlacer(placerDiagonalDR2UL);
 	generator.addPlacer(placerDiagonalUR2DL);
 	generator.addPlacer(placerDiagonalDL2UR);
+}
+
+WsError wsGenerate(const char *const *words, int count, unsigned int seed,
+		int maxIterations, const WsAllocator *allocator, char **grid, int *len){
+	if (!words || count <= 0 || maxIterations < 0 || !grid || !len)
+		return WS_ERR_ARGUMENT;
+	ErrorsMuted muted;
+	WordList list;
+	for (int i = 0; i < count; i ++){
+		if (!words[i])
+			return WS_ERR_ARGUMENT;
+		char *word = stringCopy(words[i]);
+		sanitize(word);
+		if (word[0])
+			list.add(word);
+		else
+			delete[] word;
+	}
+	if (list.count() == 0)
+		return WS_ERR_ARGUMENT;
+	GridGen generator(&list, maxIterations ? maxIterations : MAX_ITERATIONS);
+	generator.setSeed(seed);
+	addDefaultPlacers(generator);
+	if (!generator.generate())
+		return WS_ERR_NO_GRID;
+	Grid *best = generator.bestGrid();
+	best->finalize(generator.rngState());
+	char *cells = (char*)wsAllocate(allocator, best->size());
+	if (!cells)
+		return WS_ERR_MEMORY;
+	for (int addr = 0; addr < best->size(); addr ++)
+		cells[addr] = best->cell(addr);
+	*grid = cells;
+	*len = best->length();
+	return WS_OK;
+}
+
+#ifndef WORDSEARCH_LIBRARY
+int main(int argc, char **argv){
+	const char *filename = "input.txt", *outFilename = "output.txt";
+	if (argc >= 1)
+		filename = argv[1];
+	if (argc >= 2)
+		outFilename = argv[2];
+	WordList *words = new WordList();
+	if (!words->fromFile(filename)){
+		delete words;
+		return 1;
+	}
+	GridGen generator(words);
+	// optional checkpoint file: resumed from if it exists, kept updated,
+	// removed once the search is over
+	const char *checkpointFilename = argc >= 4 ? argv[3] : nullptr;
+	if (checkpointFilename)
+		generator.setCheckpoint(checkpointFilename);
+	addDefaultPlacers(generator);
+	if (checkpointFilename && std::ifstream(checkpointFilename) &&
+			!generator.loadCheckpoint(checkpointFilename)){
+		delete words;
+		return 1;
+	}
 	if (!generator.generate()){
-		std::cerr << "Failed to generate grid. Adjust SIZE_MULTIPLIER\n";
+		errors() << "Failed to generate grid. Adjust SIZE_MULTIPLIER\n";
 		delete words;
-		exit(1);
+		return 1;
 	}
 
 	Grid *grid = generator.bestGrid();
@@ -784,11 +1191,14 @@ int main(int argc, char **argv){
 		std::cout << "best one had a score of " << generator.bestGridScore() << "\n";
 		grid->print();
 		std::cout << "final grid:\n";
-		grid->finalize();
+		grid->finalize(generator.rngState());
 		grid->print();
-		if (!grid->toFile(outFilename))
-			exit(1);
+		if (!grid->toFile(outFilename)){
+			delete words;
+			return 1;
+		}
 	}
 	delete words;
 	return 0;
 }
+#endif
@@ -1,402 +1,4969 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "wordsearch.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
 
 #define SIZE_STEP 16
 
-/// Length of string
-int length(const char *str){
-	int l = 0;
-	while (str[l])
-		l ++;
-	return l;
+/// number of queries a batch worker takes at a time
+#define BATCH_CHUNK 16
+
+/// longest request line the server accepts
+#define SERVER_MAX_LINE 65536
+
+/// longest response the server sends
+#define SERVER_MAX_RESPONSE 16384
+
+/// most bytes of responses the server holds for a client that does not
+/// read them, before dropping it
+#define SERVER_MAX_BACKLOG (1 << 20)
+
+/// bytes read at a time when streaming a grid
+#define STREAM_BLOCK (1 << 20)
+
+/// default rows per band when streaming a grid
+#define STREAM_BAND_ROWS 256
+
+/// max distance of closest matches suggested for words not found
+#define FUZZY_MAX_DISTANCE 2
+
+/// number of separately locked shards in a ResultCache
+#define CACHE_SHARDS 16
+
+/// max results the server caches
+#define SERVER_CACHE_SIZE 65536
+
+/// number of letters a cell can hold
+#define ALPHABETS 26
+
+/// letters per 64 bit word in packed layout, 5 bits each
+#define PACKED_LETTERS 12
+
+/// bits used by PACKED_LETTERS letters
+#define PACKED_MASK ((1ull << (5 * PACKED_LETTERS)) - 1)
+
+/// bitmask with a bit for every letter
+#define ALL_LETTERS ((1u << ALPHABETS) - 1)
+
+/// number of directions a word can be in
+#define DIRECTIONS 8
+
+/// number of line families (rows, columns, diagonals, anti-diagonals)
+#define LINE_FAMILIES 4
+
+/// letters in benchmark grids
+#define BENCH_ALPHABETS 25
+
+/// queries times cells a benchmark aims for, per engine & query set
+#define BENCH_WORK 1000000000ll
+
+/// queries times cells the benchmark's reference engine runs
+#define BENCH_SCAN_WORK 30000000ll
+
+/// fewest & most queries per benchmark query set
+#define BENCH_MIN_QUERIES 4
+#define BENCH_MAX_QUERIES 1000
+
+/// zero bytes after the end of a text passed to substringScan, so it can
+/// read whole vectors past the last possible match
+#define SCAN_PADDING 32
+
+/// reads a whole file into buffer, which is grown (with new[]) when it has
+/// less than the file's length + 1 bytes of capacity, and null terminated.
+/// Lets many files be read without an allocation each
+///
+/// Returns: true if done, false if errored (reason written to stderr)
+bool readFileInto(const char *filename, char *&buffer, long long &capacity,
+		long long &len){
+	const int fd = open(filename, O_RDONLY);
+	struct stat info;
+	if (fd == -1 || fstat(fd, &info) == -1){
+		errors() << "Failed to open file " << filename << "\n";
+		if (fd != -1)
+			close(fd);
+		return false;
+	}
+	len = info.st_size;
+	if (len + 1 > capacity){
+		delete[] buffer;
+		capacity = len + 1 > capacity * 2 ? len + 1 : capacity * 2;
+		buffer = new char[capacity];
+	}
+	long long done = 0;
+	while (done < len){
+		const ssize_t got = read(fd, buffer + done, len - done);
+		if (got == -1 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		done += got;
+	}
+	close(fd);
+	if (done != len){
+		errors() << "Failed to read file " << filename << "\n";
+		return false;
+	}
+	buffer[len] = 0;
+	return true;
+}
+
+/// reads a whole file into a new buffer, followed by a 0
+///
+/// Returns: buffer, or nullptr if errored
+char *readFile(const char *filename, long long &len){
+	char *buffer = nullptr;
+	long long capacity = 0;
+	if (!readFileInto(filename, buffer, capacity, len)){
+		delete[] buffer;
+		return nullptr;
+	}
+	return buffer;
+}
+
+/// if two strings are equal
+bool stringEquals(const char *a, const char *b){
+	int i = 0;
+	while (a[i] && a[i] == b[i])
+		i ++;
+	return a[i] == b[i];
+}
+
+/// to store r1, c1, r2, c2
+struct WordPos{
+	int r1, c1, r2, c2;
+	WordPos(int r = -1, int c = -1, int rr = -1, int cc = -1){
+		r1 = r;
+		c1 = c;
+		r2 = rr;
+		c2 = cc;
+	}
+	bool isValid(){
+		return r1 >= 0 && c1 >= 0 && r2 >= 0 && c2 >= 0;
+	}
+};
+
+bool operator==(const WordPos a, const WordPos b){
+	return a.r1 == b.r1 && a.c1 == b.c1 && a.r2 == b.r2 && a.c2 == b.c2;
+}
+
+std::ostream& operator<<(std::ostream& stream, const WordPos pos){
+	stream << '{' << pos.r1 << ',' << pos.c1 << "},{" <<
+		pos.r2 << ',' << pos.c2 << "}";
+	return stream;
+}
+
+/// how findFuzzy measures distance between a word and part of a line
+enum FuzzyMetric{
+	/// substituted letters only
+	FUZZY_HAMMING,
+	/// substituted, inserted or removed letters
+	FUZZY_LEVENSHTEIN
+};
+
+/// an approximate occurrence, and its distance from the word
+struct FuzzyPos{
+	WordPos pos;
+	/// -1 if none found
+	int distance;
+};
+
+/// parses a pattern into a bitmask of allowed letters per position.
+/// Pattern has letters, `?` for any letter, and `[ABC]` for any one of the
+/// letters in brackets (`[^ABC]` for any but those). Case does not matter.
+/// classes must have room for length(pattern) items
+///
+/// Returns: number of positions, or -1 if pattern is invalid
+int parsePattern(const char *pattern, unsigned int *classes){
+	int len = 0;
+	for (int i = 0; pattern[i]; i ++){
+		const char c = pattern[i] | 0x20; // lowercase
+		if (c >= 'a' && c <= 'z'){
+			classes[len ++] = 1u << (c - 'a');
+		}else if (pattern[i] == '?'){
+			classes[len ++] = ALL_LETTERS;
+		}else if (pattern[i] == '['){
+			const bool negate = pattern[i + 1] == '^';
+			unsigned int cls = 0;
+			for (i += 1 + negate; pattern[i] != ']'; i ++){
+				const char l = pattern[i] | 0x20;
+				if (l < 'a' || l > 'z')
+					return -1; // unclosed, or not a letter
+				cls |= 1u << (l - 'a');
+			}
+			classes[len ++] = negate ? ALL_LETTERS & ~cls : cls;
+		}else{
+			return -1;
+		}
+	}
+	return len;
+}
+
+class WordSearchGrid;
+
+/// row & column step of each direction. In the same order as the finders
+/// are added in main, so index here is the finder index. Opposite directions
+/// are next to each other, so dir ^ 1 is the opposite of dir
+const int DIR_R[DIRECTIONS] = {0, 0, 1, -1, 1, -1, 1, -1};
+const int DIR_C[DIRECTIONS] = {1, -1, 0, 0, 1, -1, -1, 1};
+
+/// Returns: index into DIR_R/DIR_C of direction dr, dc, at compile time
+constexpr int directionOf(int dr, int dc){
+	return dr == 0 ? (dc > 0 ? 0 : 1) : dc == 0 ? (dr > 0 ? 2 : 3) :
+		dr == dc ? (dr > 0 ? 4 : 5) : (dr > 0 ? 6 : 7);
+}
+
+/// Aho-Corasick automaton over a set of words, for looking for all of them
+/// in a single pass over the grid.
+///
+/// All words must be added before build() is called.
+class WordAutomaton{
+private:
+	/// transitions, ALPHABETS per state
+	int *_next;
+	/// dictionary suffix link of each state (nearest suffix state that ends
+	/// a word), 0 if none
+	int *_dict;
+	/// first word ending at each state, -1 if none
+	int *_stateWord;
+	/// number of states
+	int _states;
+	/// capacity of state arrays
+	int _statesCap;
+
+	/// length of each word
+	int *_wordLen;
+	/// state at which each word ends
+	int *_wordState;
+	/// next word ending at the same state, -1 if none
+	int *_wordNext;
+	/// number of words
+	int _count;
+	/// capacity of word arrays
+	int _countCap;
+	/// length of longest word
+	int _maxLen;
+
+	/// if build() has been called
+	bool _built;
+
+	/// grows an int array to newCap, keeping first len items (at most
+	/// newCap). arr may be nullptr if len is 0
+	static int *_grow(int *arr, int len, int newCap){
+		int *newArr = new int[newCap];
+		if (len > newCap)
+			len = newCap;
+		if (arr == nullptr || len <= 0){
+			delete[] arr;
+			return newArr;
+		}
+		memcpy(newArr, arr, sizeof(int) * len);
+		delete[] arr;
+		return newArr;
+	}
+	/// appends a new state
+	/// Returns: its index
+	int _addState(){
+		if (_states == _statesCap){
+			const int newCap = _statesCap * 2;
+			_next = _grow(_next, _states * ALPHABETS, newCap * ALPHABETS);
+			_dict = _grow(_dict, _states, newCap);
+			_stateWord = _grow(_stateWord, _states, newCap);
+			_statesCap = newCap;
+		}
+		for (int i = 0; i < ALPHABETS; i ++)
+			_next[_states * ALPHABETS + i] = 0;
+		_dict[_states] = 0;
+		_stateWord[_states] = -1;
+		return _states ++;
+	}
+public:
+	WordAutomaton(){
+		_statesCap = SIZE_STEP;
+		_next = new int[_statesCap * ALPHABETS];
+		_dict = new int[_statesCap];
+		_stateWord = new int[_statesCap];
+		_states = 0;
+		_addState(); // root
+
+		_countCap = SIZE_STEP;
+		_wordLen = new int[_countCap];
+		_wordState = new int[_countCap];
+		_wordNext = new int[_countCap];
+		_count = 0;
+		_maxLen = 0;
+		_built = false;
+	}
+	~WordAutomaton(){
+		delete[] _next;
+		delete[] _dict;
+		delete[] _stateWord;
+		delete[] _wordLen;
+		delete[] _wordState;
+		delete[] _wordNext;
+	}
+	/// Returns: number of words
+	int count() const{
+		return _count;
+	}
+	/// Returns: length of longest word
+	int maxLength() const{
+		return _maxLen;
+	}
+	/// Returns: length of word at index
+	int length(int word) const{
+		return _wordLen[word];
+	}
+	/// adds a word. It must be sanitized. Empty words are added but can
+	/// never be found, so indexes stay the same as the order of adding.
+	///
+	/// Returns: index of word, or -1 if already built or word is invalid
+	int add(const char *word){
+		if (_built || word == nullptr)
+			return -1;
+		int state = 0, len = 0;
+		for (; word[len]; len ++){
+			const int letter = word[len] - 'A';
+			if (letter < 0 || letter >= ALPHABETS)
+				return -1;
+		}
+		for (int i = 0; i < len; i ++){
+			const int letter = word[i] - 'A';
+			int next = _next[state * ALPHABETS + letter];
+			if (next == 0){
+				next = _addState();
+				_next[state * ALPHABETS + letter] = next;
+			}
+			state = next;
+		}
+		if (_count == _countCap){
+			const int newCap = _countCap * 2;
+			_wordLen = _grow(_wordLen, _count, newCap);
+			_wordState = _grow(_wordState, _count, newCap);
+			_wordNext = _grow(_wordNext, _count, newCap);
+			_countCap = newCap;
+		}
+		_wordLen[_count] = len;
+		if (len > _maxLen)
+			_maxLen = len;
+		_wordState[_count] = len ? state : -1;
+		_wordNext[_count] = -1;
+		if (len){
+			// append to the end of this state's chain, to keep word order
+			if (_stateWord[state] == -1){
+				_stateWord[state] = _count;
+			}else{
+				int w = _stateWord[state];
+				while (_wordNext[w] != -1)
+					w = _wordNext[w];
+				_wordNext[w] = _count;
+			}
+		}
+		return _count ++;
+	}
+	/// builds failure transitions. Call after adding all words
+	void build(){
+		if (_built)
+			return;
+		_built = true;
+		int *fail = new int[_states];
+		int *queue = new int[_states];
+		int head = 0, tail = 0;
+		fail[0] = 0;
+		for (int i = 0; i < ALPHABETS; i ++){
+			const int state = _next[i];
+			if (state){
+				fail[state] = 0;
+				queue[tail ++] = state;
+			}
+		}
+		while (head < tail){
+			const int state = queue[head ++];
+			for (int i = 0; i < ALPHABETS; i ++){
+				const int next = _next[state * ALPHABETS + i];
+				const int failNext = _next[fail[state] * ALPHABETS + i];
+				if (next == 0){
+					// no edge, jump to where failure state would go
+					_next[state * ALPHABETS + i] = failNext;
+					continue;
+				}
+				fail[next] = failNext;
+				_dict[next] = _stateWord[failNext] != -1 ? failNext : _dict[failNext];
+				queue[tail ++] = next;
+			}
+		}
+		delete[] fail;
+		delete[] queue;
+	}
+	/// Returns: state after reading a letter (A-Z) in state
+	int next(int state, char letter) const{
+		return _next[state * ALPHABETS + letter - 'A'];
+	}
+	/// Returns: first word that ends at state, or -1 if none
+	int firstMatch(int state) const{
+		if (_stateWord[state] != -1)
+			return _stateWord[state];
+		return _dict[state] ? _stateWord[_dict[state]] : -1;
+	}
+	/// Returns: next word that ends at the same position as word, or -1
+	int nextMatch(int word) const{
+		if (_wordNext[word] != -1)
+			return _wordNext[word];
+		const int state = _dict[_wordState[word]];
+		return state ? _stateWord[state] : -1;
+	}
+};
+
+/// runs automaton over every line of a region of rows x cols cells, in all
+/// directions. Matches whose topmost row is in [claimFrom, claimTo) are kept
+/// in best, as (address in whole grid) * DIRECTIONS + direction, where the
+/// region starts at row rowOffset of the whole grid. Smaller is kept, so
+/// each word ends up with the first match in address then finder order.
+///
+/// best must have automaton->count() items, -1 for none yet
+void solveRegion(const WordAutomaton *automaton, const char *cells, int rows,
+		int cols, long long rowOffset, int claimFrom, int claimTo, long long *best){
+	for (int dir = 0; dir < DIRECTIONS; dir ++){
+		const int dr = DIR_R[dir], dc = DIR_C[dir];
+		for (int rStart = 0; rStart < rows; rStart ++){
+			for (int cStart = 0; cStart < cols; cStart ++){
+				// only start at cells with nothing before them in this direction
+				const int rPrev = rStart - dr, cPrev = cStart - dc;
+				if (rPrev >= 0 && rPrev < rows && cPrev >= 0 && cPrev < cols)
+					continue;
+				int r = rStart, c = cStart, state = 0;
+				while (r >= 0 && r < rows && c >= 0 && c < cols){
+					state = automaton->next(state, cells[(long long)r * cols + c]);
+					for (int word = automaton->firstMatch(state); word != -1;
+							word = automaton->nextMatch(word)){
+						const int back = automaton->length(word) - 1;
+						const int rFirst = r - back * dr;
+						const int top = rFirst < r ? rFirst : r;
+						if (top < claimFrom || top >= claimTo)
+							continue;
+						const long long key = ((rFirst + rowOffset) * cols +
+								c - back * dc) * DIRECTIONS + dir;
+						if (best[word] == -1 || key < best[word])
+							best[word] = key;
+					}
+					r += dr, c += dc;
+				}
+			}
+		}
+	}
+}
+
+/// turns best matches from solveRegion into positions, in a grid of cols
+/// columns. Words with no match get an invalid position
+void solveResults(const WordAutomaton *automaton, const long long *best, int cols,
+		WordPos *results){
+	for (int i = 0; i < automaton->count(); i ++){
+		if (best[i] == -1){
+			results[i] = WordPos();
+			continue;
+		}
+		const int dir = best[i] % DIRECTIONS, back = automaton->length(i) - 1;
+		const long long addr = best[i] / DIRECTIONS;
+		const int r = addr / cols, c = addr % cols;
+		results[i] = WordPos(r, c, r + back * DIR_R[dir], c + back * DIR_C[dir]);
+	}
+}
+
+/// reads a grid file one row at a time, through a fixed size block buffer,
+/// so grids larger than memory can be streamed. Rows are validated like in
+/// WordSearchGrid::fromFile
+class GridRowReader{
+private:
+	std::ifstream _file;
+	/// block of file
+	char *_block;
+	int _blockLen;
+	int _blockPos;
+	/// current line, growable
+	char *_line;
+	int _lineCap;
+	/// columns, -1 until first row is read
+	int _cols;
+	/// if first row was read but not yet taken
+	bool _firstPending;
+	bool _error;
+
+	/// reads next non-empty line into _line
+	/// Returns: its length, 0 at end of file
+	int _readLine(){
+		int len = 0;
+		while (true){
+			if (_blockPos == _blockLen){
+				_file.read(_block, STREAM_BLOCK);
+				_blockLen = _file.gcount();
+				_blockPos = 0;
+				if (_blockLen == 0)
+					return len;
+			}
+			const char c = _block[_blockPos ++];
+			if (c == '\n' || c == '\r'){
+				if (len)
+					return len;
+				continue; // ignore empty lines
+			}
+			if (len == _lineCap){
+				char *newLine = new char[_lineCap * 2];
+				memcpy(newLine, _line, len);
+				delete[] _line;
+				_line = newLine;
+				_lineCap *= 2;
+			}
+			_line[len ++] = c;
+		}
+	}
+	/// validates line, and makes it uppercase
+	/// Returns: false if invalid
+	bool _validate(int len){
+		for (int i = 0; i < len; i ++){
+			if ((unsigned char)((_line[i] | 0x20) - 'a') >= ALPHABETS){
+				errors() << "Non alphabet character found. File is invalid.\n";
+				return false;
+			}
+			_line[i] &= ~0x20;
+		}
+		if (_cols != -1 && len != _cols){
+			errors() << "Varying length lines found. File is invalid.\n";
+			return false;
+		}
+		return true;
+	}
+public:
+	GridRowReader(){
+		_block = new char[STREAM_BLOCK];
+		_blockLen = _blockPos = 0;
+		_lineCap = STREAM_BLOCK;
+		_line = new char[_lineCap];
+		_cols = -1;
+		_firstPending = false;
+		_error = false;
+	}
+	~GridRowReader(){
+		delete[] _block;
+		delete[] _line;
+	}
+	/// opens file, and reads first row
+	/// Returns: false if errored
+	bool open(const char *filename){
+		_file.open(filename, std::ios::binary);
+		if (!_file){
+			errors() << "Failed to open file " << filename << "\n";
+			_error = true;
+			return false;
+		}
+		const int len = _readLine();
+		if (!_validate(len)){
+			_error = true;
+			return false;
+		}
+		_cols = len;
+		_firstPending = len > 0;
+		return true;
+	}
+	/// columns in grid
+	int cols(){
+		return _cols;
+	}
+	/// if an invalid row was found
+	bool error(){
+		return _error;
+	}
+	/// reads next row into row, which must have room for cols() letters
+	/// Returns: false at end of file or if errored (see error())
+	bool next(char *row){
+		int len;
+		if (_firstPending){
+			_firstPending = false;
+			len = _cols;
+		}else{
+			len = _readLine();
+			if (len == 0)
+				return false;
+			if (!_validate(len)){
+				_error = true;
+				return false;
+			}
+		}
+		memcpy(row, _line, len);
+		return true;
+	}
+};
+
+/// finds all words of an automaton in a grid file without loading all of
+/// it: rows are read in bands of bandRows, each overlapping the next by
+/// (longest word - 1) rows, so matches across band edges are seen whole. A
+/// match is only counted in the band holding its topmost row, so none is
+/// counted twice. Memory used is (bandRows + overlap) * columns.
+///
+/// Results are the same as WordSearchGrid::solve on the whole grid.
+///
+/// Returns: false if errored
+bool solveStreaming(const char *filename, const WordAutomaton *automaton,
+		WordPos *results, int bandRows){
+	GridRowReader reader;
+	if (!reader.open(filename))
+		return false;
+	const int cols = reader.cols(), count = automaton->count();
+	const int overlap = automaton->maxLength() > 1 ? automaton->maxLength() - 1 : 0;
+	if (bandRows < 1)
+		bandRows = 1;
+	const int bandCap = bandRows + overlap;
+	char *band = new char[(long long)bandCap * cols];
+	long long *best = new long long[count];
+	for (int i = 0; i < count; i ++)
+		best[i] = -1;
+	long long bandStart = 0; // row of whole grid that band starts at
+	int loaded = 0;
+	bool end = cols == 0;
+	while (!end){
+		while (loaded < bandCap && !end){
+			if (reader.next(band + (long long)loaded * cols))
+				loaded ++;
+			else
+				end = true;
+		}
+		if (reader.error()){
+			delete[] band;
+			delete[] best;
+			return false;
+		}
+		// at the end, this band has the rest of the grid
+		const int claimTo = end ? loaded : bandRows;
+		solveRegion(automaton, band, loaded, cols, bandStart, 0, claimTo, best);
+		if (end)
+			break;
+		// rows past the claimed ones start the next band
+		loaded -= bandRows;
+		memmove(band, band + (long long)bandRows * cols, (long long)loaded * cols);
+		bandStart += bandRows;
+	}
+	solveResults(automaton, best, cols, results);
+	delete[] band;
+	delete[] best;
+	return true;
+}
+
+/// trie over a dictionary of words, in a compact layout: children of a node
+/// are stored next to each other (breadth first), and each node keeps only a
+/// bitmask of which letters it has children for.
+///
+/// Build once with fromFile, then use it on any number of grids.
+class DictTrie{
+private:
+	/// bitmask of letters each node has children for
+	unsigned int *_mask;
+	/// index of first child of each node
+	int *_first;
+	/// word ending at each node, -1 if none
+	int *_word;
+	/// number of nodes
+	int _nodes;
+
+	/// letters of all words, each followed by a 0
+	char *_letters;
+	/// start of each word in _letters
+	int *_wordStart;
+	/// number of words
+	int _count;
+
+	/// frees everything
+	void _clear(){
+		delete[] _mask;
+		delete[] _first;
+		delete[] _word;
+		delete[] _letters;
+		delete[] _wordStart;
+		_mask = nullptr;
+		_first = _word = _wordStart = nullptr;
+		_letters = nullptr;
+		_nodes = _count = 0;
+	}
+public:
+	DictTrie(){
+		_mask = nullptr;
+		_first = _word = _wordStart = nullptr;
+		_letters = nullptr;
+		_nodes = _count = 0;
+	}
+	~DictTrie(){
+		_clear();
+	}
+	/// Returns: number of (unique) words
+	int count() const{
+		return _count;
+	}
+	/// Returns: word at index
+	const char *word(int index) const{
+		if (index < 0 || index >= _count)
+			return nullptr;
+		return _letters + _wordStart[index];
+	}
+	/// Returns: root node
+	int root() const{
+		return 0;
+	}
+	/// Returns: child of node for letter (A-Z), or -1 if none
+	int child(int node, char letter) const{
+		const unsigned int bit = 1u << (letter - 'A');
+		if (!(_mask[node] & bit))
+			return -1;
+		return _first[node] + __builtin_popcount(_mask[node] & (bit - 1));
+	}
+	/// Returns: word ending at node, or -1 if none
+	int wordAt(int node) const{
+		return _word[node];
+	}
+	/// builds trie from newline-separated file of words. Words are sanitized,
+	/// empty and repeated ones are skipped.
+	///
+	/// Returns: true if done, false if errored
+	bool fromFile(const char *filename){
+		std::ifstream file(filename);
+		if (!file){
+			errors() << "Failed to open file " << filename << '\n';
+			return false;
+		}
+		_clear();
+		// build a plain trie first, ALPHABETS children per node
+		int cap = SIZE_STEP, nodes = 1;
+		int *next = new int[cap * ALPHABETS];
+		int *word = new int[cap];
+		for (int i = 0; i < ALPHABETS; i ++)
+			next[i] = 0;
+		word[0] = -1;
+		int lettersCap = SIZE_STEP * SIZE_STEP, lettersLen = 0;
+		char *letters = new char[lettersCap];
+		int startsCap = SIZE_STEP;
+		int *starts = new int[startsCap];
+
+		char buffer[100];
+		while (!file.eof()){
+			file.getline(buffer, 100);
+			if (file.fail() && !file.eof()){
+				// too long for a word, skip rest of line
+				file.clear();
+				file.ignore(1 << 30, '\n');
+				continue;
+			}
+			sanitize(buffer);
+			if (buffer[0] == 0)
+				continue;
+			int node = 0, len = 0;
+			for (; buffer[len]; len ++){
+				const int letter = buffer[len] - 'A';
+				if (next[node * ALPHABETS + letter] == 0){
+					if (nodes == cap){
+						int *newNext = new int[cap * 2 * ALPHABETS];
+						int *newWord = new int[cap * 2];
+						for (int i = 0; i < nodes * ALPHABETS; i ++)
+							newNext[i] = next[i];
+						for (int i = 0; i < nodes; i ++)
+							newWord[i] = word[i];
+						delete[] next;
+						delete[] word;
+						next = newNext;
+						word = newWord;
+						cap *= 2;
+					}
+					for (int i = 0; i < ALPHABETS; i ++)
+						next[nodes * ALPHABETS + i] = 0;
+					word[nodes] = -1;
+					next[node * ALPHABETS + letter] = nodes ++;
+				}
+				node = next[node * ALPHABETS + letter];
+			}
+			if (word[node] != -1)
+				continue; // repeated
+			// store the word
+			if (_count == startsCap){
+				int *newStarts = new int[startsCap * 2];
+				for (int i = 0; i < _count; i ++)
+					newStarts[i] = starts[i];
+				delete[] starts;
+				starts = newStarts;
+				startsCap *= 2;
+			}
+			if (lettersLen + len + 1 > lettersCap){
+				while (lettersLen + len + 1 > lettersCap)
+					lettersCap *= 2;
+				char *newLetters = new char[lettersCap];
+				for (int i = 0; i < lettersLen; i ++)
+					newLetters[i] = letters[i];
+				delete[] letters;
+				letters = newLetters;
+			}
+			starts[_count] = lettersLen;
+			for (int i = 0; i <= len; i ++)
+				letters[lettersLen ++] = buffer[i];
+			word[node] = _count ++;
+		}
+		file.close();
+
+		// now lay it out breadth first
+		_nodes = nodes;
+		_mask = new unsigned int[nodes];
+		_first = new int[nodes];
+		_word = new int[nodes];
+		int *queue = new int[nodes]; // old index of each new node
+		int head = 0, tail = 1;
+		queue[0] = 0;
+		while (head < tail){
+			const int old = queue[head];
+			_mask[head] = 0;
+			_first[head] = tail;
+			_word[head] = word[old];
+			for (int i = 0; i < ALPHABETS; i ++){
+				const int child = next[old * ALPHABETS + i];
+				if (child == 0)
+					continue;
+				_mask[head] |= 1u << i;
+				queue[tail ++] = child;
+			}
+			head ++;
+		}
+		delete[] queue;
+		delete[] next;
+		delete[] word;
+		_letters = letters;
+		_wordStart = starts;
+		return true;
+	}
+};
+
+/// prototype of function that is used to check if a word exists at an address
+/// the arguments passed are:
+/// * the grid
+/// * word
+/// * length of word
+/// * cell address
+/// * row & column of that cell
+typedef WordPos (*FinderFunc)(WordSearchGrid*, char*, int, int, int, int);
+
+/// prototype of function that receives words found in grid
+/// the arguments passed are:
+/// * index of word
+/// * position of word
+/// * data pointer that was passed along
+typedef void (*WordHitFunc)(int, WordPos, void*);
+
+/// prototype of function that receives every occurrence of a word
+/// the arguments passed are:
+/// * position of occurrence
+/// * data pointer that was passed along
+/// Returns: false to stop looking for more
+typedef bool (*OccurrenceFunc)(WordPos, void*);
+
+/// prototype of function that receives offsets of substring matches
+/// the arguments passed are:
+/// * offset in text where match starts
+/// * data pointer that was passed along
+typedef void (*OffsetHitFunc)(int, void*);
+
+/// prototype of function that finds all occurrences of pattern in text
+/// the arguments passed are:
+/// * text, followed by SCAN_PADDING readable bytes
+/// * length of text
+/// * pattern
+/// * length of pattern (at least 1)
+/// * function to pass each match to
+/// * data pointer to pass along
+typedef void (*SubstringScanFunc)(const char*, int, const char*, int,
+		OffsetHitFunc, void*);
+
+/// if pattern matches text at offset, excluding first & last letters
+inline bool middleEquals(const char *text, const char *pattern, int len){
+	for (int i = 1; i < len - 1; i ++){
+		if (text[i] != pattern[i])
+			return false;
+	}
+	return true;
+}
+
+/// substringScan without SIMD
+void substringScanScalar(const char *text, int textLen, const char *pattern,
+		int len, OffsetHitFunc func, void *data){
+	const char first = pattern[0], last = pattern[len - 1];
+	for (int i = 0; i + len <= textLen; i ++){
+		if (text[i] == first && text[i + len - 1] == last &&
+				middleEquals(text + i, pattern, len))
+			func(i, data);
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+/// substringScan, comparing first & last letters of 16 positions at once
+__attribute__((target("sse2")))
+void substringScanSSE2(const char *text, int textLen, const char *pattern,
+		int len, OffsetHitFunc func, void *data){
+	const __m128i first = _mm_set1_epi8(pattern[0]);
+	const __m128i last = _mm_set1_epi8(pattern[len - 1]);
+	const int end = textLen - len + 1; // positions that can match
+	for (int i = 0; i < end; i += 16){
+		const __m128i blockFirst = _mm_loadu_si128((const __m128i*)(text + i));
+		const __m128i blockLast =
+			_mm_loadu_si128((const __m128i*)(text + i + len - 1));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+					_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast)));
+		while (mask){
+			const int offset = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+			if (offset < end && middleEquals(text + offset, pattern, len))
+				func(offset, data);
+		}
+	}
+}
+
+/// substringScan, comparing first & last letters of 32 positions at once
+__attribute__((target("avx2")))
+void substringScanAVX2(const char *text, int textLen, const char *pattern,
+		int len, OffsetHitFunc func, void *data){
+	const __m256i first = _mm256_set1_epi8(pattern[0]);
+	const __m256i last = _mm256_set1_epi8(pattern[len - 1]);
+	const int end = textLen - len + 1;
+	for (int i = 0; i < end; i += 32){
+		const __m256i blockFirst = _mm256_loadu_si256((const __m256i*)(text + i));
+		const __m256i blockLast =
+			_mm256_loadu_si256((const __m256i*)(text + i + len - 1));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(
+					_mm256_cmpeq_epi8(first, blockFirst),
+					_mm256_cmpeq_epi8(last, blockLast)));
+		while (mask){
+			const int offset = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+			if (offset < end && middleEquals(text + offset, pattern, len))
+				func(offset, data);
+		}
+	}
+}
+#endif
+
+/// picks fastest substringScan the CPU supports
+SubstringScanFunc substringScanPick(){
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return substringScanAVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return substringScanSSE2;
+#endif
+	return substringScanScalar;
+}
+
+/// finds all occurrences of pattern in text. Picked at runtime
+const SubstringScanFunc substringScan = substringScanPick();
+
+/// bounded LRU cache of find results, keyed by grid identity & word. Split
+/// into shards, each with its own lock, so threads rarely wait on each
+/// other. Entries remember the grid version they were found in, and are
+/// dropped when looked up against any other version.
+class ResultCache{
+private:
+	struct Entry{
+		unsigned long long grid;
+		unsigned long long version;
+		unsigned int hash;
+		char *word;
+		WordPos pos;
+		/// more & less recently used
+		Entry *prev, *next;
+		/// next in hash bucket
+		Entry *chain;
+	};
+	struct Shard{
+		std::mutex mutex;
+		/// hash buckets, power of 2 count
+		Entry **buckets;
+		unsigned int mask;
+		/// most & least recently used
+		Entry *head, *tail;
+		int count;
+	};
+	Shard *_shards;
+	int _shardsCount;
+	/// max entries per shard
+	int _shardCap;
+
+	std::atomic<unsigned long long> _hits, _misses, _evictions;
+
+	/// FNV-1a of word, mixed with grid
+	static unsigned int _hash(unsigned long long grid, const char *word){
+		unsigned int hash = 2166136261u ^ (unsigned int)(grid * 2654435761u);
+		for (int i = 0; word[i]; i ++)
+			hash = (hash ^ (unsigned char)word[i]) * 16777619u;
+		return hash;
+	}
+	/// unlinks entry from LRU list
+	static void _unlink(Shard *shard, Entry *entry){
+		if (entry->prev)
+			entry->prev->next = entry->next;
+		else
+			shard->head = entry->next;
+		if (entry->next)
+			entry->next->prev = entry->prev;
+		else
+			shard->tail = entry->prev;
+	}
+	/// links entry at front of LRU list
+	static void _pushFront(Shard *shard, Entry *entry){
+		entry->prev = nullptr;
+		entry->next = shard->head;
+		if (shard->head)
+			shard->head->prev = entry;
+		shard->head = entry;
+		if (!shard->tail)
+			shard->tail = entry;
+	}
+	/// removes entry from shard and frees it
+	static void _remove(Shard *shard, Entry *entry){
+		Entry **link = &shard->buckets[entry->hash & shard->mask];
+		while (*link != entry)
+			link = &(*link)->chain;
+		*link = entry->chain;
+		_unlink(shard, entry);
+		delete[] entry->word;
+		delete entry;
+		shard->count --;
+	}
+	/// Returns: entry for grid & word in shard, or nullptr
+	static Entry *_lookup(Shard *shard, unsigned int hash, unsigned long long grid,
+			const char *word){
+		for (Entry *entry = shard->buckets[hash & shard->mask]; entry;
+				entry = entry->chain){
+			if (entry->hash == hash && entry->grid == grid &&
+					stringEquals(entry->word, word))
+				return entry;
+		}
+		return nullptr;
+	}
+	/// Returns: shard for a hash
+	Shard *_shard(unsigned int hash){
+		return &_shards[(hash >> 16) % _shardsCount];
+	}
+public:
+	/// constructor. capacity is max number of entries overall
+	ResultCache(int capacity, int shards = CACHE_SHARDS){
+		_shardsCount = shards < 1 ? 1 : shards;
+		_shardCap = capacity / _shardsCount;
+		if (_shardCap < 1)
+			_shardCap = 1;
+		unsigned int buckets = 1;
+		while (buckets < (unsigned int)_shardCap * 2)
+			buckets *= 2;
+		_shards = new Shard[_shardsCount];
+		for (int i = 0; i < _shardsCount; i ++){
+			_shards[i].buckets = new Entry*[buckets];
+			for (unsigned int j = 0; j < buckets; j ++)
+				_shards[i].buckets[j] = nullptr;
+			_shards[i].mask = buckets - 1;
+			_shards[i].head = _shards[i].tail = nullptr;
+			_shards[i].count = 0;
+		}
+		_hits = _misses = _evictions = 0;
+	}
+	~ResultCache(){
+		for (int i = 0; i < _shardsCount; i ++){
+			while (_shards[i].head)
+				_remove(&_shards[i], _shards[i].head);
+			delete[] _shards[i].buckets;
+		}
+		delete[] _shards;
+	}
+	/// number of lookups that were found
+	unsigned long long hits(){
+		return _hits;
+	}
+	/// number of lookups that were not found (or were stale)
+	unsigned long long misses(){
+		return _misses;
+	}
+	/// number of entries dropped to make room
+	unsigned long long evictions(){
+		return _evictions;
+	}
+	/// looks up result of word in grid, at version
+	/// Returns: true if found, with result in pos
+	bool get(unsigned long long grid, unsigned long long version, const char *word,
+			WordPos &pos){
+		const unsigned int hash = _hash(grid, word);
+		Shard *shard = _shard(hash);
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		Entry *entry = _lookup(shard, hash, grid, word);
+		if (entry && entry->version != version){
+			_remove(shard, entry); // grid changed since
+			entry = nullptr;
+		}
+		if (!entry){
+			_misses ++;
+			return false;
+		}
+		_unlink(shard, entry);
+		_pushFront(shard, entry);
+		pos = entry->pos;
+		_hits ++;
+		return true;
+	}
+	/// stores result of word in grid, at version
+	void put(unsigned long long grid, unsigned long long version, const char *word,
+			WordPos pos){
+		const unsigned int hash = _hash(grid, word);
+		Shard *shard = _shard(hash);
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		Entry *entry = _lookup(shard, hash, grid, word);
+		if (entry){
+			_unlink(shard, entry);
+		}else{
+			entry = new Entry;
+			const int len = length(word);
+			entry->word = new char[len + 1];
+			for (int i = 0; i <= len; i ++)
+				entry->word[i] = word[i];
+			entry->grid = grid;
+			entry->hash = hash;
+			entry->chain = shard->buckets[hash & shard->mask];
+			shard->buckets[hash & shard->mask] = entry;
+			shard->count ++;
+		}
+		entry->version = version;
+		entry->pos = pos;
+		_pushFront(shard, entry);
+		while (shard->count > _shardCap){
+			_remove(shard, shard->tail);
+			_evictions ++;
+		}
+	}
+};
+
+/// next identity to give a WordSearchGrid
+std::atomic<unsigned long long> gridIdNext(1);
+
+#ifdef SOLVER_STATS
+/// Instrumentation, compiled in with -DSOLVER_STATS. Without it, STATS()
+/// statements are left out and cost nothing.
+#define STATS(statement) statement
+
+/// early exit depths counted separately. Deeper exits share the last one
+#define STATS_DEPTHS 16
+
+/// latency histogram buckets. Bucket i counts times of 2^i .. 2^(i+1) - 1
+/// nanoseconds
+#define STATS_LATENCY_BUCKETS 40
+
+/// engines counted, one per SearchEngine
+#define STATS_ENGINES 5
+
+/// counters of one thread. Only that thread writes them; other threads
+/// just read them for snapshots. Relaxed atomics are enough for that, so
+/// counting takes no locks
+struct ThreadStats{
+	/// finder calls, per direction
+	std::atomic<unsigned long long> invocations[DIRECTIONS];
+	/// cells whose letter a finder compared, per direction
+	std::atomic<unsigned long long> cellsVisited[DIRECTIONS];
+	/// finder calls that found the word, per direction
+	std::atomic<unsigned long long> matches[DIRECTIONS];
+	/// finder calls that did not, by letters matched before giving up
+	std::atomic<unsigned long long> exitDepth[DIRECTIONS][STATS_DEPTHS];
+	/// find calls answered by each engine, and those that found the word
+	std::atomic<unsigned long long> engineFinds[STATS_ENGINES];
+	std::atomic<unsigned long long> engineMatches[STATS_ENGINES];
+	/// positions each engine checked one by one: finder calls for scan and
+	/// index, substring hits for lines, cells left after ANDing planes for
+	/// planes, suffixes compared or walked for suffix
+	std::atomic<unsigned long long> engineCandidates[STATS_ENGINES];
+	std::atomic<unsigned long long> loadNs[STATS_LATENCY_BUCKETS];
+	std::atomic<unsigned long long> findNs[STATS_LATENCY_BUCKETS];
+	/// counters of the thread that started before this one
+	ThreadStats *next;
+};
+
+/// counters of every thread that ever counted anything, newest first
+std::atomic<ThreadStats*> statsThreads(nullptr);
+
+/// Returns: this thread's counters. They are added to statsThreads on
+/// first use and never freed, so counts of finished threads stay in
+/// snapshots
+ThreadStats &threadStats(){
+	thread_local ThreadStats *stats = nullptr;
+	if (!stats){
+		stats = new ThreadStats();
+		stats->next = statsThreads.load();
+		while (!statsThreads.compare_exchange_weak(stats->next, stats)){}
+	}
+	return *stats;
+}
+
+/// adds n to a counter only this thread writes
+inline void statsAdd(std::atomic<unsigned long long> &counter,
+		unsigned long long n = 1){
+	counter.store(counter.load(std::memory_order_relaxed) + n,
+			std::memory_order_relaxed);
+}
+
+/// counts the time it lives into a latency histogram of this thread
+struct StatsTimer{
+	std::atomic<unsigned long long> *histogram;
+	std::chrono::steady_clock::time_point start;
+	StatsTimer(std::atomic<unsigned long long> *histogram) :
+		histogram(histogram), start(std::chrono::steady_clock::now()){}
+	~StatsTimer(){
+		const unsigned long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count();
+		int bucket = 63 - __builtin_clzll(ns | 1);
+		if (bucket >= STATS_LATENCY_BUCKETS)
+			bucket = STATS_LATENCY_BUCKETS - 1;
+		statsAdd(histogram[bucket]);
+	}
+};
+
+/// counts an early exit of a finder going dir, depth letters in
+inline void statsExit(ThreadStats &stats, int dir, int depth){
+	statsAdd(stats.cellsVisited[dir], depth + 1);
+	statsAdd(stats.exitDepth[dir][depth < STATS_DEPTHS ? depth : STATS_DEPTHS - 1]);
+}
+
+/// counters summed over every thread
+struct StatsSnapshot{
+	int threads;
+	unsigned long long invocations[DIRECTIONS];
+	unsigned long long cellsVisited[DIRECTIONS];
+	unsigned long long matches[DIRECTIONS];
+	unsigned long long exitDepth[DIRECTIONS][STATS_DEPTHS];
+	unsigned long long engineFinds[STATS_ENGINES];
+	unsigned long long engineMatches[STATS_ENGINES];
+	unsigned long long engineCandidates[STATS_ENGINES];
+	unsigned long long loadNs[STATS_LATENCY_BUCKETS];
+	unsigned long long findNs[STATS_LATENCY_BUCKETS];
+};
+
+/// adds count counters of a thread onto sums
+void statsSum(unsigned long long *sums, const std::atomic<unsigned long long> *counters,
+		int count){
+	for (int i = 0; i < count; i ++)
+		sums[i] += counters[i].load(std::memory_order_relaxed);
+}
+
+/// sums counters of every thread into snapshot. Safe to call while other
+/// threads count
+void statsSnapshot(StatsSnapshot &snapshot){
+	snapshot = StatsSnapshot();
+	for (ThreadStats *stats = statsThreads.load(); stats; stats = stats->next){
+		snapshot.threads ++;
+		statsSum(snapshot.invocations, stats->invocations, DIRECTIONS);
+		statsSum(snapshot.cellsVisited, stats->cellsVisited, DIRECTIONS);
+		statsSum(snapshot.matches, stats->matches, DIRECTIONS);
+		for (int dir = 0; dir < DIRECTIONS; dir ++)
+			statsSum(snapshot.exitDepth[dir], stats->exitDepth[dir], STATS_DEPTHS);
+		statsSum(snapshot.engineFinds, stats->engineFinds, STATS_ENGINES);
+		statsSum(snapshot.engineMatches, stats->engineMatches, STATS_ENGINES);
+		statsSum(snapshot.engineCandidates, stats->engineCandidates, STATS_ENGINES);
+		statsSum(snapshot.loadNs, stats->loadNs, STATS_LATENCY_BUCKETS);
+		statsSum(snapshot.findNs, stats->findNs, STATS_LATENCY_BUCKETS);
+	}
+}
+
+/// writes count numbers as a JSON array
+void statsWriteArray(std::ostream &out, const unsigned long long *values, int count){
+	out << '[';
+	for (int i = 0; i < count; i ++)
+		out << (i ? "," : "") << values[i];
+	out << ']';
+}
+
+/// writes a snapshot of all counters as a line of JSON. Latency
+/// histograms are arrays of STATS_LATENCY_BUCKETS power of 2 buckets.
+/// Engine counters are arrays indexed by SearchEngine
+void statsWriteJson(std::ostream &out){
+	StatsSnapshot snapshot;
+	statsSnapshot(snapshot);
+	out << "{\"threads\":" << snapshot.threads << ",\"directions\":[";
+	for (int dir = 0; dir < DIRECTIONS; dir ++){
+		out << (dir ? "," : "") << "{\"dr\":" << DIR_R[dir] << ",\"dc\":" << DIR_C[dir] <<
+			",\"invocations\":" << snapshot.invocations[dir] <<
+			",\"cells_visited\":" << snapshot.cellsVisited[dir] <<
+			",\"matches\":" << snapshot.matches[dir] << ",\"exit_depth\":";
+		statsWriteArray(out, snapshot.exitDepth[dir], STATS_DEPTHS);
+		out << '}';
+	}
+	out << "],\"engine_finds\":";
+	statsWriteArray(out, snapshot.engineFinds, STATS_ENGINES);
+	out << ",\"engine_matches\":";
+	statsWriteArray(out, snapshot.engineMatches, STATS_ENGINES);
+	out << ",\"engine_candidates\":";
+	statsWriteArray(out, snapshot.engineCandidates, STATS_ENGINES);
+	out << ",\"load_ns_log2\":";
+	statsWriteArray(out, snapshot.loadNs, STATS_LATENCY_BUCKETS);
+	out << ",\"find_ns_log2\":";
+	statsWriteArray(out, snapshot.findNs, STATS_LATENCY_BUCKETS);
+	out << "}\n";
+}
+
+/// writes a snapshot to the file named by SOLVER_STATS_FILE, or stderr,
+/// when the program exits
+void statsAtExit(){
+	const char *filename = getenv("SOLVER_STATS_FILE");
+	if (filename){
+		std::ofstream file(filename);
+		statsWriteJson(file);
+	}else{
+		statsWriteJson(std::cerr);
+	}
+}
+#else
+#define STATS(statement)
+#endif
+
+/// engines that WordSearchGrid::find can use. All of them give the same
+/// results
+enum SearchEngine{
+	/// try every finder on every cell
+	ENGINE_SCAN,
+	/// only try cells holding the first letter, and only finders whose
+	/// direction has every bigram of the word
+	ENGINE_INDEX,
+	/// substring scans over every line of the grid, stored contiguously.
+	/// Ignores finders, gives same results as the finders in order of
+	/// DIR_R/DIR_C
+	ENGINE_LINES,
+	/// one bitplane per letter, testing 64 start cells at once by ANDing
+	/// each letter's plane shifted along the direction.
+	/// Ignores finders, same as ENGINE_LINES
+	ENGINE_PLANES,
+	/// binary search in a SuffixIndex, kept in a file next to the grid's.
+	/// Ignores finders, same as ENGINE_LINES
+	ENGINE_SUFFIX
+};
+
+/// row & column step of each line family, and the directions reading it
+/// forwards & backwards
+const int FAMILY_R[LINE_FAMILIES] = {0, 1, 1, 1};
+const int FAMILY_C[LINE_FAMILIES] = {1, 0, 1, -1};
+const int FAMILY_DIR[LINE_FAMILIES] = {0, 2, 4, 6};
+const int FAMILY_DIR_REV[LINE_FAMILIES] = {1, 3, 5, 7};
+
+/// identifies a suffix index file, and its layout version
+const char SUFFIX_MAGIC[8] = {'W', 'S', 'S', 'U', 'F', 'X', '1', 0};
+
+/// start of a suffix index file. Followed by, in native byte order:
+/// int lineOffset[lines + 1], int lineAddr[lines], int sa[textLen],
+/// int lcp[textLen], char text[textLen]
+struct SuffixHeader{
+	char magic[8];
+	int rows, cols;
+	/// FNV-1a hash of the grid's letters, row after row
+	unsigned long long gridHash;
+	/// letters of all lines, each line followed by a 0
+	int textLen;
+	/// number of lines
+	int lines;
+	/// first line of each line family, and the number of lines
+	int familyLine[LINE_FAMILIES + 1];
+};
+
+/// Returns: FNV-1a hash of a grid's letters
+unsigned long long gridHash(const char *cells, long long area){
+	unsigned long long hash = 14695981039346656037ull;
+	for (long long i = 0; i < area; i ++)
+		hash = (hash ^ (unsigned char)cells[i]) * 1099511628211ull;
+	return hash;
+}
+
+/// Suffix array & LCP array over every line of a grid, in each line family
+/// (as in ENGINE_LINES), read forwards. Words are looked up forwards and
+/// reversed, which covers all DIRECTIONS without storing each line twice.
+///
+/// Can be written to a file and memory mapped back, so a grid's index is
+/// built once and reused by later runs.
+class SuffixIndex{
+private:
+	int _rows, _cols;
+	unsigned long long _hash;
+	int _textLen, _lines;
+	int _familyLine[LINE_FAMILIES + 1];
+	/// text offset of each line, and one past the last
+	int *_lineOffset;
+	/// address of first cell of each line
+	int *_lineAddr;
+	/// start of suffixes in sorted order
+	int *_sa;
+	/// _lcp[i] is the length of the common prefix of suffixes _sa[i - 1]
+	/// and _sa[i]
+	int *_lcp;
+	char *_text;
+
+	/// mapped file holding the arrays, or nullptr if they are allocated
+	void *_map;
+	size_t _mapLen;
+
+	/// frees everything
+	void _clear(){
+		if (_map){
+			munmap(_map, _mapLen);
+		}else{
+			delete[] _lineOffset;
+			delete[] _lineAddr;
+			delete[] _sa;
+			delete[] _lcp;
+			delete[] _text;
+		}
+		_map = nullptr;
+		_mapLen = 0;
+		_lineOffset = _lineAddr = _sa = _lcp = nullptr;
+		_text = nullptr;
+		_rows = _cols = _textLen = _lines = 0;
+		_hash = 0;
+	}
+	/// sorts suffixes of text by prefix doubling: each round orders them
+	/// by (rank of first k letters, rank of next k letters) with a counting
+	/// sort, until all ranks differ. rank ends up as inverse of sa
+	static void _sortSuffixes(const char *text, int n, int *sa, int *rank){
+		const int buckets = n > 256 ? n : 256;
+		int *count = new int[buckets + 1];
+		int *order = new int[n];
+		int *next = new int[n];
+		for (int i = 0; i < n; i ++){
+			rank[i] = (unsigned char)text[i];
+			order[i] = i;
+		}
+		for (int k = 0; ; k = k ? k * 2 : 1){
+			if (k){
+				// order by second key. Suffixes with nothing k letters on
+				// come first
+				int j = 0;
+				for (int i = n - k > 0 ? n - k : 0; i < n; i ++)
+					order[j ++] = i;
+				for (int i = 0; i < n; i ++){
+					if (sa[i] >= k)
+						order[j ++] = sa[i] - k;
+				}
+			}
+			// stable sort by first key
+			for (int i = 0; i <= buckets; i ++)
+				count[i] = 0;
+			for (int i = 0; i < n; i ++)
+				count[rank[i] + 1] ++;
+			for (int i = 1; i <= buckets; i ++)
+				count[i] += count[i - 1];
+			for (int i = 0; i < n; i ++)
+				sa[count[rank[order[i]]] ++] = order[i];
+			// rank by both keys
+			next[sa[0]] = 0;
+			for (int i = 1; i < n; i ++){
+				const int a = sa[i - 1], b = sa[i];
+				const int secondA = k && a + k < n ? rank[a + k] : -1;
+				const int secondB = k && b + k < n ? rank[b + k] : -1;
+				next[b] = next[a] + (rank[a] != rank[b] || secondA != secondB);
+			}
+			for (int i = 0; i < n; i ++)
+				rank[i] = next[i];
+			if (rank[sa[n - 1]] == n - 1)
+				break;
+		}
+		delete[] count;
+		delete[] order;
+		delete[] next;
+	}
+	/// Returns: <0, 0 or >0 as suffix at pos is before, starts with, or is
+	/// after word (reversed if reversed)
+	int _compare(int pos, const char *word, int len, bool reversed) const{
+		const char *text = _text + pos;
+		for (int i = 0; i < len; i ++){
+			const char l = reversed ? word[len - 1 - i] : word[i];
+			if (text[i] != l)
+				return (unsigned char)text[i] < (unsigned char)l ? -1 : 1;
+		}
+		return 0;
+	}
+	/// Returns: first suffix in _sa not before word, or if upper, first one
+	/// after all that start with it
+	int _bound(const char *word, int len, bool reversed, bool upper) const{
+		int lo = 0, hi = _textLen;
+		STATS(ThreadStats &stats = threadStats());
+		while (lo < hi){
+			const int mid = lo + (hi - lo) / 2;
+			STATS(statsAdd(stats.engineCandidates[ENGINE_SUFFIX]));
+			const int cmp = _compare(_sa[mid], word, len, reversed);
+			if (cmp < 0 || (upper && cmp == 0))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+	/// Returns: line holding text position pos
+	int _lineOf(int pos) const{
+		int lo = 0, hi = _lines - 1;
+		while (lo < hi){
+			const int mid = (lo + hi + 1) / 2;
+			if (_lineOffset[mid] <= pos)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		return lo;
+	}
+	/// Returns: start & end address and direction of the occurrence of a
+	/// word of len at text position pos, read reversed if reversed
+	void _occurrence(int pos, int len, bool reversed, int &start, int &end,
+			int &dir) const{
+		const int line = _lineOf(pos);
+		int family = 0;
+		while (_familyLine[family + 1] <= line)
+			family ++;
+		const int step = FAMILY_R[family] * _cols + FAMILY_C[family];
+		const int first = _lineAddr[line] + (pos - _lineOffset[line]) * step;
+		const int last = first + (len - 1) * step;
+		start = reversed ? last : first;
+		end = reversed ? first : last;
+		dir = reversed ? FAMILY_DIR_REV[family] : FAMILY_DIR[family];
+	}
+	/// calls func with start, end address & direction of every occurrence
+	/// of word (reversed if reversed), until it returns false.
+	///
+	/// Returns: false if func did
+	bool _each(const char *word, int len, bool reversed,
+			bool (*func)(int, int, int, void*), void *data) const{
+		int i = _bound(word, len, reversed, false);
+		if (i >= _textLen || _compare(_sa[i], word, len, reversed) != 0)
+			return true;
+		// suffixes after the first that share at least len letters with it
+		// also start with word
+		STATS(ThreadStats &stats = threadStats());
+		do{
+			int start, end, dir;
+			STATS(statsAdd(stats.engineCandidates[ENGINE_SUFFIX]));
+			_occurrence(_sa[i], len, reversed, start, end, dir);
+			if (!func(start, end, dir, data))
+				return false;
+			i ++;
+		}while (i < _textLen && _lcp[i] >= len);
+		return true;
+	}
+	/// keeps the first occurrence in the order of find
+	static bool _keepFirst(int start, int end, int dir, void *data){
+		long long *best = (long long*)data;
+		const long long key = (long long)start * DIRECTIONS + dir;
+		if (best[0] == -1 || key < best[0]){
+			best[0] = key;
+			best[1] = end;
+		}
+		return true;
+	}
+	/// what findAll passes to _each
+	struct Reporter{
+		int cols;
+		/// only direction reported, -1 for all
+		int dir;
+		OccurrenceFunc func;
+		void *data;
+		int count;
+	};
+	static bool _report(int start, int end, int dir, void *data){
+		Reporter *reporter = (Reporter*)data;
+		if (reporter->dir != -1 && dir != reporter->dir)
+			return true;
+		reporter->count ++;
+		return reporter->func(WordPos(start / reporter->cols, start % reporter->cols,
+					end / reporter->cols, end % reporter->cols), reporter->data);
+	}
+	/// Returns: length of the text of a rows x cols grid: every line of
+	/// each family, each followed by a 0. Sets lines to the number of lines
+	static long long _textLength(int rows, int cols, int &lines){
+		long long textLen = 0;
+		lines = 0;
+		for (int f = 0; f < LINE_FAMILIES; f ++){
+			for (int r = 0; r < rows; r ++){
+				for (int c = 0; c < cols; c ++){
+					const int rPrev = r - FAMILY_R[f], cPrev = c - FAMILY_C[f];
+					lines += !(rPrev >= 0 && rPrev < rows && cPrev >= 0 && cPrev < cols);
+				}
+			}
+			textLen += (long long)rows * cols;
+		}
+		return textLen + lines;
+	}
+	/// Returns: true if the arrays, as mapped from a file, are those of a
+	/// rows x cols grid: every line, offset and suffix in range, and the
+	/// text ending in a 0, so no search reads past them
+	bool _checkArrays(int rows, int cols) const{
+		int lines;
+		if (_rows != rows || _cols != cols ||
+				_textLength(rows, cols, lines) != _textLen || lines != _lines)
+			return false;
+		if (_familyLine[0] != 0 || _familyLine[LINE_FAMILIES] != _lines)
+			return false;
+		for (int f = 0; f < LINE_FAMILIES; f ++){
+			if (_familyLine[f] > _familyLine[f + 1])
+				return false;
+		}
+		if (_lineOffset[0] != 0 || _lineOffset[_lines] != _textLen)
+			return false;
+		for (int i = 0; i < _lines; i ++){
+			if (_lineOffset[i] >= _lineOffset[i + 1] || _lineAddr[i] < 0 ||
+					_lineAddr[i] >= rows * cols)
+				return false;
+		}
+		for (int i = 0; i < _textLen; i ++){
+			if (_sa[i] < 0 || _sa[i] >= _textLen || _lcp[i] < 0 || _lcp[i] > _textLen)
+				return false;
+		}
+		return _textLen == 0 || _text[_textLen - 1] == 0;
+	}
+	/// Returns: true if word reads the same reversed
+	static bool _palindrome(const char *word, int len){
+		for (int i = 0; i < len / 2; i ++){
+			if (word[i] != word[len - 1 - i])
+				return false;
+		}
+		return true;
+	}
+public:
+	SuffixIndex(){
+		_map = nullptr;
+		_lineOffset = _lineAddr = _sa = _lcp = nullptr;
+		_text = nullptr;
+		_clear();
+	}
+	~SuffixIndex(){
+		_clear();
+	}
+	/// if it has been built or opened
+	bool isReady() const{
+		return _sa != nullptr;
+	}
+	/// if it was built for this grid
+	bool isOf(int rows, int cols, unsigned long long hash) const{
+		return isReady() && rows == _rows && cols == _cols && hash == _hash;
+	}
+	/// builds from a grid's cells, row after row.
+	///
+	/// Returns: false if the grid is too large to index
+	bool build(const char *cells, int rows, int cols){
+		_clear();
+		const long long area = (long long)rows * cols;
+		int lines;
+		const long long textLen = _textLength(rows, cols, lines);
+		if (textLen >= 0x7fffffff){
+			errors() << "Grid too large to index\n";
+			return false;
+		}
+		_rows = rows;
+		_cols = cols;
+		_hash = gridHash(cells, area);
+		_textLen = textLen;
+		_lines = lines;
+		_lineOffset = new int[lines + 1];
+		_lineAddr = new int[lines];
+		_text = new char[_textLen];
+		int line = 0, offset = 0;
+		for (int f = 0; f < LINE_FAMILIES; f ++){
+			_familyLine[f] = line;
+			const int dr = FAMILY_R[f], dc = FAMILY_C[f];
+			for (int r = 0; r < rows; r ++){
+				for (int c = 0; c < cols; c ++){
+					const int rPrev = r - dr, cPrev = c - dc;
+					if (rPrev >= 0 && rPrev < rows && cPrev >= 0 && cPrev < cols)
+						continue;
+					_lineOffset[line] = offset;
+					_lineAddr[line ++] = r * cols + c;
+					for (int rr = r, cc = c; rr < rows && cc >= 0 && cc < cols;
+							rr += dr, cc += dc)
+						_text[offset ++] = cells[rr * cols + cc];
+					_text[offset ++] = 0;
+				}
+			}
+		}
+		_familyLine[LINE_FAMILIES] = line;
+		_lineOffset[lines] = offset;
+		_sa = new int[_textLen];
+		_lcp = new int[_textLen];
+		if (_textLen == 0)
+			return true;
+		int *rank = new int[_textLen];
+		_sortSuffixes(_text, _textLen, _sa, rank);
+		// Kasai: the common prefix with the previous suffix shrinks by at
+		// most one going from suffix i to i + 1
+		int common = 0;
+		_lcp[0] = 0;
+		for (int i = 0; i < _textLen; i ++){
+			if (rank[i] == 0){
+				common = 0;
+				continue;
+			}
+			const int j = _sa[rank[i] - 1];
+			while (i + common < _textLen && j + common < _textLen &&
+					_text[i + common] == _text[j + common])
+				common ++;
+			_lcp[rank[i]] = common;
+			if (common)
+				common --;
+		}
+		delete[] rank;
+		return true;
+	}
+	/// writes the index to filename, through a temporary file renamed over
+	/// it, so readers never see a partial index.
+	///
+	/// Returns: true if done, false if errored (reason written to stderr)
+	bool write(const char *filename) const{
+		if (!isReady())
+			return false;
+		const int nameLen = length(filename);
+		char *tempName = new char[nameLen + 5];
+		memcpy(tempName, filename, nameLen);
+		memcpy(tempName + nameLen, ".tmp", 5);
+		std::ofstream file(tempName, std::ios::binary);
+		if (!file){
+			errors() << "Failed to open index file " << tempName << "\n";
+			delete[] tempName;
+			return false;
+		}
+		SuffixHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, SUFFIX_MAGIC, sizeof(header.magic));
+		header.rows = _rows;
+		header.cols = _cols;
+		header.gridHash = _hash;
+		header.textLen = _textLen;
+		header.lines = _lines;
+		for (int f = 0; f <= LINE_FAMILIES; f ++)
+			header.familyLine[f] = _familyLine[f];
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)_lineOffset, sizeof(int) * (_lines + 1));
+		file.write((const char*)_lineAddr, sizeof(int) * _lines);
+		file.write((const char*)_sa, sizeof(int) * (long long)_textLen);
+		file.write((const char*)_lcp, sizeof(int) * (long long)_textLen);
+		file.write(_text, _textLen);
+		file.close();
+		const bool done = file && rename(tempName, filename) == 0;
+		if (!done){
+			errors() << "Failed to write index file " << filename << "\n";
+			unlink(tempName);
+		}
+		delete[] tempName;
+		return done;
+	}
+	/// maps an index written by write, for a rows x cols grid. Its arrays
+	/// are checked once, so a corrupt file is rejected rather than read out
+	/// of bounds; letters are checked by isOf.
+	///
+	/// Returns: true if done, false if file is missing or not an index of
+	/// such a grid
+	bool open(const char *filename, int rows, int cols){
+		_clear();
+		const int fd = ::open(filename, O_RDONLY);
+		if (fd == -1)
+			return false;
+		struct stat info;
+		if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SuffixHeader)){
+			close(fd);
+			return false;
+		}
+		void *map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED)
+			return false;
+		const SuffixHeader *header = (const SuffixHeader*)map;
+		const long long expected = sizeof(SuffixHeader) +
+			sizeof(int) * (2ll * header->lines + 1 + 2ll * header->textLen) + header->textLen;
+		if (memcmp(header->magic, SUFFIX_MAGIC, sizeof(header->magic)) != 0 ||
+				header->lines < 0 || header->textLen < 0 || expected != info.st_size){
+			munmap(map, info.st_size);
+			return false;
+		}
+		_map = map;
+		_mapLen = info.st_size;
+		_rows = header->rows;
+		_cols = header->cols;
+		_hash = header->gridHash;
+		_textLen = header->textLen;
+		_lines = header->lines;
+		for (int f = 0; f <= LINE_FAMILIES; f ++)
+			_familyLine[f] = header->familyLine[f];
+		int *ints = (int*)(header + 1);
+		_lineOffset = ints;
+		_lineAddr = _lineOffset + _lines + 1;
+		_sa = _lineAddr + _lines;
+		_lcp = _sa + _textLen;
+		_text = (char*)(_lcp + _textLen);
+		if (!_checkArrays(rows, cols)){
+			_clear();
+			return false;
+		}
+		return true;
+	}
+	/// finds a word, giving the same position as WordSearchGrid::find with
+	/// finders in order of DIR_R/DIR_C. O(len * log(text) + occurrences)
+	WordPos find(const char *word) const{
+		const int len = length(word);
+		if (len == 0 || !isReady())
+			return WordPos();
+		long long best[2] = {-1, 0};
+		_each(word, len, false, _keepFirst, best);
+		if (len > 1 && !_palindrome(word, len))
+			_each(word, len, true, _keepFirst, best);
+		if (best[0] == -1)
+			return WordPos();
+		const int start = best[0] / DIRECTIONS, end = best[1];
+		return WordPos(start / _cols, start % _cols, end / _cols, end % _cols);
+	}
+	/// calls func with every occurrence of word, in no particular order,
+	/// until it returns false. Occurrences are as in WordSearchGrid::findAll
+	/// with a finder for every direction.
+	///
+	/// Returns: number of occurrences func was called with
+	int findAll(const char *word, OccurrenceFunc func, void *data) const{
+		const int len = length(word);
+		if (len == 0 || !isReady())
+			return 0;
+		// single letters are in a line of each family, so are reported
+		// from rows only. They & palindromes read the same both ways, so
+		// are reported once, forwards
+		Reporter reporter = {_cols, len == 1 ? FAMILY_DIR[0] : -1, func, data, 0};
+		if (_each(word, len, false, _report, &reporter) && len > 1 &&
+				!_palindrome(word, len))
+			_each(word, len, true, _report, &reporter);
+		return reporter.count;
+	}
+	/// Returns: number of cell & direction pairs the grid reads prefix
+	/// from, without visiting them. O(len * log(text))
+	long long countPrefix(const char *prefix) const{
+		const int len = length(prefix);
+		if (len == 0 || !isReady())
+			return 0;
+		long long count = 0;
+		for (int reversed = 0; reversed < 2; reversed ++){
+			count += _bound(prefix, len, reversed, true) -
+				_bound(prefix, len, reversed, false);
+		}
+		return count;
+	}
+};
+
+class WordSearchGrid{
+private:
+	/// the grid. 2D array mapped onto a 1D. nullptr in packed layout
+	char *_grid;
+	/// the grid in packed layout, PACKED_LETTERS letters of 5 bits per
+	/// word, followed by a zero word
+	unsigned long long *_packed;
+	/// if grid is in packed layout
+	bool _packedLayout;
+	/// rows in grid
+	int _rows;
+	/// columns in grid
+	int _cols;
+	/// number of characters in grid (area)
+	int _area;
+
+	/// dummy
+	char _dummy;
+
+	/// finder functions
+	FinderFunc *_finders;
+	/// direction (index in DIR_R/DIR_C) of each finder, -1 if unknown
+	int *_finderDirs;
+	/// number of finder functions
+	int _findersCount;
+
+	/// engine used by find
+	SearchEngine _engine;
+
+	/// unique identity of this grid, for caching
+	unsigned long long _id;
+	/// incremented whenever results of find may change
+	unsigned long long _version;
+	/// cache in front of find, if any
+	ResultCache *_cache;
+
+	/// cell addresses, grouped by letter, ascending in each group
+	int *_letterCells;
+	/// index in _letterCells where each letter's group starts
+	int _letterStart[ALPHABETS + 1];
+	/// bigrams present in each direction: bit b of _bigrams[dir][a] is set
+	/// if letter a is followed by letter b in direction dir
+	unsigned int _bigrams[DIRECTIONS][ALPHABETS];
+	/// number of times letter a is followed by letter b in direction dir,
+	/// so setCell knows when a bigram is gone
+	int _bigramCounts[DIRECTIONS][ALPHABETS][ALPHABETS];
+
+	/// a word re-answered after every setCell
+	struct Watched{
+		char *word;
+		int len;
+		/// addr * DIRECTIONS + dir of every occurrence, ascending
+		long long *keys;
+		int count, capacity;
+		/// first occurrence, as find would give with a finder for every
+		/// direction
+		WordPos pos;
+	};
+	Watched *_watched;
+	int _watchedCount, _watchedCapacity;
+	/// called with index & new position of watched words whose position
+	/// changed
+	WordHitFunc _watchFunc;
+	void *_watchData;
+
+	/// every line of each family, one after another, each followed by a 0.
+	/// Followed by SCAN_PADDING zeroes
+	char *_lines[LINE_FAMILIES];
+	/// length of each _lines, excluding padding
+	int _linesLen[LINE_FAMILIES];
+	/// number of lines in each family
+	int _lineCount[LINE_FAMILIES];
+	/// offset in _lines where each line starts, followed by _linesLen
+	int *_lineOffset[LINE_FAMILIES];
+	/// address of first cell of each line
+	int *_lineAddr[LINE_FAMILIES];
+
+	/// what a line scan is looking for, and best match so far
+	struct LineScan{
+		WordSearchGrid *grid;
+		int family;
+		/// length of word
+		int len;
+		/// if it is looking for the reversed word
+		bool reversed;
+		/// best match: addr * DIRECTIONS + direction, -1 if none
+		long long best;
+	};
+
+	/// takes a match from a line scan
+	static void _lineHit(int offset, void *data){
+		LineScan *scan = (LineScan*)data;
+		STATS(statsAdd(threadStats().engineCandidates[ENGINE_LINES]));
+		int r, c;
+		scan->grid->lineCell(scan->family, offset, r, c);
+		int dir = FAMILY_DIR[scan->family];
+		if (scan->reversed){
+			// word starts at the other end
+			r += (scan->len - 1) * FAMILY_R[scan->family];
+			c += (scan->len - 1) * FAMILY_C[scan->family];
+			dir = FAMILY_DIR_REV[scan->family];
+		}
+		const long long key = (long long)scan->grid->linAddr(r, c) * DIRECTIONS + dir;
+		if (scan->best == -1 || key < scan->best)
+			scan->best = key;
+	}
+	/// frees line buffers
+	void _freeLines(){
+		_linesReady = false;
+		for (int f = 0; f < LINE_FAMILIES; f ++){
+			delete[] _lines[f];
+			delete[] _lineOffset[f];
+			delete[] _lineAddr[f];
+			_lines[f] = nullptr;
+			_lineOffset[f] = _lineAddr[f] = nullptr;
+			_linesLen[f] = _lineCount[f] = 0;
+		}
+	}
+	/// builds line buffers of all families
+	void _buildLines(){
+		_freeLines();
+		for (int f = 0; f < LINE_FAMILIES; f ++){
+			const int dr = FAMILY_R[f], dc = FAMILY_C[f];
+			int count = 0;
+			for (int r = 0; r < _rows; r ++){
+				for (int c = 0; c < _cols; c ++){
+					const int rPrev = r - dr, cPrev = c - dc;
+					count += !(rPrev >= 0 && rPrev < _rows && cPrev >= 0 && cPrev < _cols);
+				}
+			}
+			_lineCount[f] = count;
+			_linesLen[f] = _area + count;
+			_lines[f] = new char[_linesLen[f] + SCAN_PADDING];
+			_lineOffset[f] = new int[count + 1];
+			_lineAddr[f] = new int[count];
+			int line = 0, offset = 0;
+			for (int r = 0; r < _rows; r ++){
+				for (int c = 0; c < _cols; c ++){
+					const int rPrev = r - dr, cPrev = c - dc;
+					if (rPrev >= 0 && rPrev < _rows && cPrev >= 0 && cPrev < _cols)
+						continue;
+					_lineOffset[f][line] = offset;
+					_lineAddr[f][line ++] = linAddr(r, c);
+					for (int rr = r, cc = c; rr < _rows && cc >= 0 && cc < _cols;
+							rr += dr, cc += dc)
+						_lines[f][offset ++] = letter(rr, cc);
+					_lines[f][offset ++] = 0;
+				}
+			}
+			_lineOffset[f][count] = offset;
+			for (int i = 0; i < SCAN_PADDING; i ++)
+				_lines[f][offset + i] = 0;
+		}
+		_linesReady = true;
+	}
+	/// one bitplane per letter, _planeWords words each. bit addr of plane
+	/// l is set if cell at addr holds letter l
+	unsigned long long *_planes;
+	/// number of 64 bit words per plane
+	int _planeWords;
+
+	/// suffix index of the grid (ENGINE_SUFFIX), nullptr if not built
+	SuffixIndex *_suffix;
+	/// where the suffix index is kept: next to the grid's file, or nullptr
+	/// if grid was not loaded from a file or was edited since
+	char *_suffixFile;
+
+	/// maps the suffix index from _suffixFile, building and writing it
+	/// first if it is missing or of another grid
+	/// Returns: false if it could not be built, or not written
+	bool _buildSuffix(){
+		if (_suffix)
+			return _suffix->isReady();
+		_suffix = new SuffixIndex();
+		char *cells = _grid;
+		if (_packedLayout){
+			cells = new char[_area];
+			for (int r = 0; r < _rows; r ++)
+				unpackRow(r, cells + r * _cols);
+		}
+		bool done = true;
+		if (!_suffixFile || !_suffix->open(_suffixFile, _rows, _cols) ||
+				!_suffix->isOf(_rows, _cols, gridHash(cells, _area))){
+			done = _suffix->build(cells, _rows, _cols) &&
+					(!_suffixFile || _suffix->write(_suffixFile));
+		}
+		if (cells != _grid)
+			delete[] cells;
+		_suffixReady = true;
+		return done;
+	}
+	/// frees suffix index
+	void _freeSuffix(){
+		_suffixReady = false;
+		delete _suffix;
+		_suffix = nullptr;
+	}
+
+	/// frees letter bitplanes
+	void _freePlanes(){
+		_planesReady = false;
+		delete[] _planes;
+		_planes = nullptr;
+		_planeWords = 0;
+	}
+	/// builds letter bitplanes
+	void _buildPlanes(){
+		delete[] _planes;
+		_planeWords = (_area + 63) / 64;
+		_planes = new unsigned long long[ALPHABETS * _planeWords];
+		for (int i = 0; i < ALPHABETS * _planeWords; i ++)
+			_planes[i] = 0;
+		for (int addr = 0; addr < _area; addr ++)
+			_planes[(letter(addr) - 'A') * _planeWords + addr / 64] |= 1ull << (addr % 64);
+		_planesReady = true;
+	}
+	/// Returns: 64 bits of a plane starting at bit, which may be out of
+	/// range. Bits out of range are 0
+	unsigned long long _planeBits(const unsigned long long *plane, long long bit){
+		long long word = bit >> 6; // floor, even for negative
+		const int shift = bit & 63;
+		const unsigned long long lo = word >= 0 && word < _planeWords ? plane[word] : 0;
+		if (shift == 0)
+			return lo;
+		word ++;
+		const unsigned long long hi = word >= 0 && word < _planeWords ? plane[word] : 0;
+		return (lo >> shift) | (hi << (64 - shift));
+	}
+	/// if a word of len letters starting at r, c fits in direction
+	bool _fits(int r, int c, int dir, int len){
+		const int rEnd = r + (len - 1) * DIR_R[dir], cEnd = c + (len - 1) * DIR_C[dir];
+		return rEnd >= 0 && rEnd < _rows && cEnd >= 0 && cEnd < _cols;
+	}
+	/// Returns: bits of 64 start cells from start, where each position i along
+	/// delta holds a letter in classes[i]. Bits may be set where the word
+	/// would wrap around a row, or run off the grid
+	unsigned long long _planeMatch(const unsigned int *classes, int len,
+			long long start, long long delta){
+		unsigned long long bits = ~0ull;
+		for (int i = 0; i < len && bits; i ++){
+			if (classes[i] == ALL_LETTERS)
+				continue; // wildcard, only the fit check matters
+			unsigned long long any = 0;
+			for (unsigned int rest = classes[i]; rest; rest &= rest - 1)
+				any |= _planeBits(_planes + __builtin_ctz(rest) * _planeWords,
+						start + i * delta);
+			bits &= any;
+		}
+		return bits;
+	}
+	/// passes every placement where position i holds a letter of classes[i]
+	/// to func, in order of address then direction, until it returns false.
+	/// Duplicates are skipped like in findAll.
+	///
+	/// Returns: number of placements passed to func
+	int _planeScan(const unsigned int *classes, int len, OccurrenceFunc func,
+			void *data){
+		bool symmetric = true;
+		for (int i = 0; i < len / 2 && symmetric; i ++)
+			symmetric = classes[i] == classes[len - 1 - i];
+		long long delta[DIRECTIONS];
+		for (int dir = 0; dir < DIRECTIONS; dir ++)
+			delta[dir] = (long long)DIR_R[dir] * _cols + DIR_C[dir];
+		unsigned long long matches[DIRECTIONS];
+		int count = 0;
+		for (int w = 0; w < _planeWords; w ++){
+			const long long start = (long long)w * 64;
+			unsigned long long any = 0;
+			for (int dir = 0; dir < DIRECTIONS; dir ++){
+				matches[dir] = _planeMatch(classes, len, start, delta[dir]);
+				any |= matches[dir];
+			}
+			// bits may be set where the word wraps around rows, so check fit
+			STATS(if (any) statsAdd(threadStats().engineCandidates[ENGINE_PLANES],
+					__builtin_popcountll(any)));
+			while (any){
+				const int bit = __builtin_ctzll(any);
+				any &= any - 1;
+				if (start + bit >= _area)
+					break;
+				int r, c;
+				linAddr(start + bit, r, c);
+				for (int dir = 0; dir < DIRECTIONS; dir ++){
+					if (!((matches[dir] >> bit) & 1) || !_fits(r, c, dir, len))
+						continue;
+					const WordPos pos(r, c, r + (len - 1) * DIR_R[dir],
+							c + (len - 1) * DIR_C[dir]);
+					if (len > 1 && symmetric &&
+							linAddr(pos.r1, pos.c1) > linAddr(pos.r2, pos.c2))
+						continue; // reported from other end
+					count ++;
+					if (!func(pos, data))
+						return count;
+					if (len == 1)
+						break; // same cell in every direction
+				}
+			}
+		}
+		return count;
+	}
+	/// stores first occurrence
+	/// Returns: false
+	static bool _firstOccurrence(WordPos pos, void *data){
+		*(WordPos*)data = pos;
+		return false;
+	}
+	/// find, using letter bitplanes
+	WordPos _findPlanes(char *word){
+		const int len = length(word);
+		for (int i = 0; i < len; i ++){
+			if (word[i] < 'A' || word[i] > 'Z')
+				return WordPos(); // grid only has letters
+		}
+		if (len == 0)
+			return _findScan(word);
+		unsigned int stackClasses[64];
+		unsigned int *classes = len <= 64 ? stackClasses : new unsigned int[len];
+		for (int i = 0; i < len; i ++)
+			classes[i] = 1u << (word[i] - 'A');
+		WordPos pos;
+		_planeScan(classes, len, _firstOccurrence, &pos);
+		if (classes != stackClasses)
+			delete[] classes;
+		return pos;
+	}
+	/// bit-parallel (Wu-Manber) Hamming search of a line for a pattern of
+	/// len <= 64 letters, with peq bitmasks of the pattern's letters
+	/// Returns: smallest distance below limit, with end of match in end. Or
+	/// limit if none
+	static int _hammingLine(const char *text, int n, const unsigned long long *peq,
+			int len, int limit, int &end){
+		unsigned long long state[64]; // state[d]: prefixes matching with d errors
+		const int maxDistance = limit - 1;
+		for (int d = 0; d <= maxDistance; d ++)
+			state[d] = 0;
+		const unsigned long long high = 1ull << (len - 1);
+		for (int j = 0; j < n; j ++){
+			const unsigned long long eq = peq[text[j] - 'A'];
+			unsigned long long prev = state[0];
+			state[0] = ((state[0] << 1) | 1) & eq;
+			for (int d = 1; d <= maxDistance; d ++){
+				const unsigned long long old = state[d];
+				state[d] = (((state[d] << 1) | 1) & eq) | ((prev << 1) | 1);
+				prev = old;
+			}
+			for (int d = 0; d < limit; d ++){
+				if (state[d] & high){
+					limit = d;
+					end = j;
+					break;
+				}
+			}
+		}
+		return limit;
+	}
+	/// bit-parallel (Myers) Levenshtein search of a line for a pattern of
+	/// len <= 64 letters, with peq bitmasks of the pattern's letters
+	/// Returns: smallest distance below limit, with end of match in end. Or
+	/// limit if none
+	static int _levenshteinLine(const char *text, int n, const unsigned long long *peq,
+			int len, int limit, int &end){
+		unsigned long long pv = ~0ull, mv = 0;
+		const unsigned long long high = 1ull << (len - 1);
+		int score = len;
+		for (int j = 0; j < n; j ++){
+			const unsigned long long eq = peq[text[j] - 'A'];
+			const unsigned long long xv = eq | mv;
+			const unsigned long long xh = (((eq & pv) + pv) ^ pv) | eq;
+			unsigned long long ph = mv | ~(xh | pv);
+			unsigned long long mh = pv & xh;
+			if (ph & high)
+				score ++;
+			else if (mh & high)
+				score --;
+			ph <<= 1;
+			mh <<= 1;
+			pv = mh | ~(xv | ph);
+			mv = ph & xv;
+			if (score < limit){
+				limit = score;
+				end = j;
+			}
+		}
+		return limit;
+	}
+	/// Returns: start of a Levenshtein match of pattern with distance,
+	/// ending at end of text
+	static int _levenshteinStart(const char *text, int end, const char *pattern,
+			int len, int distance){
+		// dp over pattern suffixes & text ending at end, read backwards
+		const int maxSpan = end + 1 < len + distance ? end + 1 : len + distance;
+		int *row = new int[maxSpan + 1];
+		int *next = new int[maxSpan + 1];
+		for (int l = 0; l <= maxSpan; l ++)
+			row[l] = l;
+		for (int i = 1; i <= len; i ++){
+			next[0] = i;
+			for (int l = 1; l <= maxSpan; l ++){
+				const int cost = pattern[len - i] != text[end - l + 1];
+				int best = row[l - 1] + cost;
+				if (row[l] + 1 < best)
+					best = row[l] + 1;
+				if (next[l - 1] + 1 < best)
+					best = next[l - 1] + 1;
+				next[l] = best;
+			}
+			int *temp = row;
+			row = next;
+			next = temp;
+		}
+		// the span closest to the word's length
+		int span = -1;
+		for (int l = 1; l <= maxSpan; l ++){
+			if (row[l] == distance && (span == -1 ||
+						abs(l - len) < abs(span - len)))
+				span = l;
+		}
+		delete[] row;
+		delete[] next;
+		return end - (span == -1 ? len : span) + 1;
+	}
+	/// find, using substring scans over line buffers
+	WordPos _findLines(char *word){
+		const int len = length(word);
+		if (len == 0)
+			return _findScan(word);
+		char *rev = new char[len];
+		for (int i = 0; i < len; i ++)
+			rev[i] = word[len - 1 - i];
+		long long best = -1;
+		for (int f = 0; f < LINE_FAMILIES; f ++){
+			LineScan scan = {this, f, len, false, best};
+			substringScan(_lines[f], _linesLen[f], word, len, _lineHit, &scan);
+			scan.reversed = true;
+			substringScan(_lines[f], _linesLen[f], rev, len, _lineHit, &scan);
+			best = scan.best;
+		}
+		delete[] rev;
+		if (best == -1)
+			return WordPos();
+		const int dir = best % DIRECTIONS;
+		int r, c;
+		linAddr(best / DIRECTIONS, r, c);
+		return WordPos(r, c, r + (len - 1) * DIR_R[dir], c + (len - 1) * DIR_C[dir]);
+	}
+
+	/// builds letter & bigram index
+	void _buildIndex(){
+		delete[] _letterCells;
+		_letterCells = new int[_area];
+		for (int i = 0; i <= ALPHABETS; i ++)
+			_letterStart[i] = 0;
+		for (int addr = 0; addr < _area; addr ++)
+			_letterStart[letter(addr) - 'A' + 1] ++;
+		for (int i = 0; i < ALPHABETS; i ++)
+			_letterStart[i + 1] += _letterStart[i];
+		// counting sort, so each group stays in ascending order
+		int fill[ALPHABETS];
+		for (int i = 0; i < ALPHABETS; i ++)
+			fill[i] = _letterStart[i];
+		for (int addr = 0; addr < _area; addr ++)
+			_letterCells[fill[letter(addr) - 'A'] ++] = addr;
+
+		for (int dir = 0; dir < DIRECTIONS; dir ++){
+			for (int a = 0; a < ALPHABETS; a ++){
+				for (int b = 0; b < ALPHABETS; b ++)
+					_bigramCounts[dir][a][b] = 0;
+			}
+			const int dr = DIR_R[dir], dc = DIR_C[dir];
+			for (int r = 0; r < _rows; r ++){
+				const int rNext = r + dr;
+				if (rNext < 0 || rNext >= _rows)
+					continue;
+				for (int c = 0; c < _cols; c ++){
+					const int cNext = c + dc;
+					if (cNext < 0 || cNext >= _cols)
+						continue;
+					_bigramCounts[dir][letter(r, c) - 'A'][letter(rNext, cNext) - 'A'] ++;
+				}
+			}
+			for (int a = 0; a < ALPHABETS; a ++){
+				_bigrams[dir][a] = 0;
+				for (int b = 0; b < ALPHABETS; b ++)
+					_bigrams[dir][a] |= (_bigramCounts[dir][a][b] > 0) << b;
+			}
+		}
+	}
+	/// frees letter index
+	void _freeIndex(){
+		delete[] _letterCells;
+		_letterCells = nullptr;
+		for (int i = 0; i <= ALPHABETS; i ++)
+			_letterStart[i] = 0;
+	}
+	/// Returns: first index in lo .. hi - 1 of arr (ascending) holding more
+	/// than value, or hi
+	static int _upperBound(const int *arr, int lo, int hi, int value){
+		while (lo < hi){
+			const int mid = lo + (hi - lo) / 2;
+			if (arr[mid] <= value)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+	/// moves addr from letter from's group of _letterCells to letter to's,
+	/// keeping groups ascending. Only cells between the two places move
+	void _moveLetterCell(int addr, int from, int to){
+		const int pos = _upperBound(_letterCells, _letterStart[from],
+				_letterStart[from + 1], addr) - 1;
+		const int insert = _upperBound(_letterCells, _letterStart[to],
+				_letterStart[to + 1], addr);
+		if (from < to){
+			memmove(_letterCells + pos, _letterCells + pos + 1,
+					sizeof(int) * (insert - pos - 1));
+			_letterCells[insert - 1] = addr;
+			for (int l = from + 1; l <= to; l ++)
+				_letterStart[l] --;
+		}else{
+			memmove(_letterCells + insert + 1, _letterCells + insert,
+					sizeof(int) * (pos - insert));
+			_letterCells[insert] = addr;
+			for (int l = to + 1; l <= from; l ++)
+				_letterStart[l] ++;
+		}
+	}
+	/// updates letter & bigram index for cell r, c changing from letter
+	/// from to letter to (0 based)
+	void _updateIndex(int r, int c, int from, int to){
+		_moveLetterCell(linAddr(r, c), from, to);
+		for (int dir = 0; dir < DIRECTIONS; dir ++){
+			const int rNext = r + DIR_R[dir], cNext = c + DIR_C[dir];
+			if (rNext < 0 || rNext >= _rows || cNext < 0 || cNext >= _cols)
+				continue;
+			// bigram from this cell in dir, and the opposite one into it
+			const int next = letter(rNext, cNext) - 'A';
+			int *counts[2] = {_bigramCounts[dir][from] + next, _bigramCounts[dir ^ 1][next] + from};
+			-- *counts[0];
+			-- *counts[1];
+			_bigramCounts[dir][to][next] ++;
+			_bigramCounts[dir ^ 1][next][to] ++;
+			if (!*counts[0])
+				_bigrams[dir][from] &= ~(1u << next);
+			if (!*counts[1])
+				_bigrams[dir ^ 1][next] &= ~(1u << from);
+			_bigrams[dir][to] |= 1u << next;
+			_bigrams[dir ^ 1][next] |= 1u << to;
+		}
+	}
+	/// Returns: offset of cell r, c in line family f's buffer
+	int _lineOffsetOf(int f, int r, int c){
+		// steps back to the start of its line
+		int back = FAMILY_R[f] ? r : _cols;
+		if (FAMILY_C[f] > 0 && c < back)
+			back = c;
+		else if (FAMILY_C[f] < 0 && _cols - 1 - c < back)
+			back = _cols - 1 - c;
+		const int start = linAddr(r - back * FAMILY_R[f], c - back * FAMILY_C[f]);
+		// lines are in order of their first cell
+		const int line = _upperBound(_lineAddr[f], 0, _lineCount[f], start) - 1;
+		return _lineOffset[f][line] + back;
+	}
+	/// Returns: if word (of len) reads from r, c going dir
+	bool _readsAt(const char *word, int len, int r, int c, int dir){
+		const int dr = DIR_R[dir], dc = DIR_C[dir];
+		const int rEnd = r + dr * (len - 1), cEnd = c + dc * (len - 1);
+		if (r < 0 || r >= _rows || c < 0 || c >= _cols ||
+				rEnd < 0 || rEnd >= _rows || cEnd < 0 || cEnd >= _cols)
+			return false;
+		for (int i = 0; i < len; i ++){
+			if (letter(r + dr * i, c + dc * i) != word[i])
+				return false;
+		}
+		return true;
+	}
+	/// adds or removes key from a watched word's occurrences
+	void _watchedSet(Watched &watched, long long key, bool present){
+		int lo = 0, hi = watched.count;
+		while (lo < hi){
+			const int mid = lo + (hi - lo) / 2;
+			if (watched.keys[mid] < key)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		const bool found = lo < watched.count && watched.keys[lo] == key;
+		if (present == found)
+			return;
+		if (!present){
+			memmove(watched.keys + lo, watched.keys + lo + 1,
+					sizeof(long long) * (watched.count - lo - 1));
+			watched.count --;
+			return;
+		}
+		if (watched.count == watched.capacity){
+			watched.capacity = watched.capacity ? watched.capacity * 2 : SIZE_STEP;
+			long long *keys = new long long[watched.capacity];
+			for (int i = 0; i < watched.count; i ++)
+				keys[i] = watched.keys[i];
+			delete[] watched.keys;
+			watched.keys = keys;
+		}
+		memmove(watched.keys + lo + 1, watched.keys + lo,
+				sizeof(long long) * (watched.count - lo));
+		watched.keys[lo] = key;
+		watched.count ++;
+	}
+	/// sets a watched word's position from its first occurrence, telling
+	/// _watchFunc if it changed and notify is set
+	void _watchedAnswer(int index, bool notify){
+		Watched &watched = _watched[index];
+		WordPos pos;
+		if (watched.count){
+			const int dir = watched.keys[0] % DIRECTIONS;
+			int r, c;
+			linAddr(watched.keys[0] / DIRECTIONS, r, c);
+			pos = WordPos(r, c, r + (watched.len - 1) * DIR_R[dir],
+					c + (watched.len - 1) * DIR_C[dir]);
+		}
+		const bool changed = !(pos == watched.pos);
+		watched.pos = pos;
+		if (changed && notify && _watchFunc)
+			_watchFunc(index, pos, _watchData);
+	}
+	/// finds every occurrence of a watched word in the whole grid
+	void _watchedScan(int index, bool notify){
+		Watched &watched = _watched[index];
+		watched.count = 0;
+		for (int r = 0; r < _rows; r ++){
+			for (int c = 0; c < _cols; c ++){
+				for (int dir = 0; dir < DIRECTIONS; dir ++){
+					if (watched.len && _readsAt(watched.word, watched.len, r, c, dir))
+						_watchedSet(watched, (long long)linAddr(r, c) * DIRECTIONS + dir, true);
+				}
+			}
+		}
+		_watchedAnswer(index, notify);
+	}
+	/// rechecks the occurrences of watched words through cell r, c: for
+	/// each direction, only the len starts whose segment covers it
+	void _watchedUpdate(int r, int c){
+		for (int i = 0; i < _watchedCount; i ++){
+			Watched &watched = _watched[i];
+			for (int dir = 0; dir < DIRECTIONS; dir ++){
+				for (int k = 0; k < watched.len; k ++){
+					const int rStart = r - k * DIR_R[dir], cStart = c - k * DIR_C[dir];
+					if (rStart < 0 || rStart >= _rows || cStart < 0 || cStart >= _cols)
+						break;
+					_watchedSet(watched, (long long)linAddr(rStart, cStart) * DIRECTIONS + dir,
+							_readsAt(watched.word, watched.len, rStart, cStart, dir));
+				}
+			}
+			_watchedAnswer(i, true);
+		}
+	}
+	/// if a grid is loaded
+	bool _loaded(){
+		return _grid || _packed;
+	}
+	/// converts _grid to packed layout
+	void _pack(){
+		const int words = (_area + PACKED_LETTERS - 1) / PACKED_LETTERS + 1;
+		delete[] _packed;
+		_packed = new unsigned long long[words];
+		for (int i = 0; i < words; i ++)
+			_packed[i] = 0;
+		for (int addr = 0; addr < _area; addr ++)
+			_packed[addr / PACKED_LETTERS] |= (unsigned long long)(_grid[addr] - 'A') <<
+				(addr % PACKED_LETTERS * 5);
+		delete[] _grid;
+		_grid = nullptr;
+	}
+	/// converts packed layout back to _grid
+	void _unpack(){
+		_grid = new char[_area];
+		for (int addr = 0; addr < _area; addr ++)
+			_grid[addr] = 'A' + ((_packed[addr / PACKED_LETTERS] >>
+						(addr % PACKED_LETTERS * 5)) & 31);
+		delete[] _packed;
+		_packed = nullptr;
+	}
+	/// Returns: PACKED_LETTERS letters starting at addr, packed
+	unsigned long long _packedWindow(int addr){
+		const int word = addr / PACKED_LETTERS, shift = addr % PACKED_LETTERS * 5;
+		unsigned long long bits = _packed[word] >> shift;
+		if (shift)
+			bits |= _packed[word + 1] << (5 * PACKED_LETTERS - shift);
+		return bits & PACKED_MASK;
+	}
+	/// guards building structures on first use, when other threads may be
+	/// searching too
+	std::mutex _lazyMutex;
+	/// if line buffers, bitplanes & suffix index are built
+	std::atomic<bool> _linesReady, _planesReady, _suffixReady;
+
+	/// builds line buffers, if not built
+	void _needLines(){
+		if (_linesReady)
+			return;
+		std::lock_guard<std::mutex> lock(_lazyMutex);
+		if (!_linesReady && _loaded())
+			_buildLines();
+	}
+	/// builds bitplanes, if not built
+	void _needPlanes(){
+		if (_planesReady)
+			return;
+		std::lock_guard<std::mutex> lock(_lazyMutex);
+		if (!_planesReady && _loaded())
+			_buildPlanes();
+	}
+	/// builds suffix index, if not built
+	/// Returns: true if it can be searched
+	bool _needSuffix(){
+		if (!_suffixReady){
+			std::lock_guard<std::mutex> lock(_lazyMutex);
+			if (!_suffixReady && _loaded())
+				_buildSuffix();
+			if (!_suffixReady)
+				return false;
+		}
+		return _suffix->isReady();
+	}
+	/// builds whatever the current engine needs
+	void _buildEngine(){
+		if (!_loaded())
+			return;
+		if (_engine == ENGINE_INDEX)
+			_buildIndex();
+		else if (_engine == ENGINE_LINES)
+			_buildLines();
+		else if (_engine == ENGINE_PLANES)
+			_buildPlanes();
+		else if (_engine == ENGINE_SUFFIX)
+			_needSuffix();
+	}
+	/// counter for count
+	struct CountLimit{
+		int *count;
+		int limit;
+	};
+	/// counts an occurrence
+	/// Returns: false once limit is reached
+	static bool _countOccurrence(WordPos /*pos*/, void *data){
+		CountLimit *counter = (CountLimit*)data;
+		return ++ *counter->count != counter->limit;
+	}
+	/// rows rFrom .. rTo - 1 and cols cFrom .. cTo - 1 that a word fits in,
+	/// going some direction
+	struct FitBox{
+		int rFrom, rTo, cFrom, cTo;
+		bool holds(int r, int c) const{
+			return r >= rFrom && r < rTo && c >= cFrom && c < cTo;
+		}
+	};
+	/// fills boxes with where a word of len fits, for each of the first 64
+	/// finders. Finders of unknown direction get the whole grid
+	void _fitBoxes(int len, FitBox *boxes){
+		for (int finder = 0; finder < _findersCount && finder < 64; finder ++){
+			FitBox &box = boxes[finder];
+			box.rFrom = box.cFrom = 0;
+			box.rTo = _rows;
+			box.cTo = _cols;
+			const int dir = _finderDirs[finder];
+			if (dir == -1 || len == 0)
+				continue;
+			const int dr = DIR_R[dir] * (len - 1), dc = DIR_C[dir] * (len - 1);
+			if (dr > 0)
+				box.rTo -= dr;
+			else
+				box.rFrom -= dr;
+			if (dc > 0)
+				box.cTo -= dc;
+			else
+				box.cFrom -= dc;
+		}
+	}
+	/// find, trying every finder on every cell the word fits from
+	WordPos _findScan(char *word){
+		const int len = length(word);
+		FitBox boxes[64];
+		_fitBoxes(len, boxes);
+		STATS(ThreadStats &stats = threadStats());
+		int addr = 0;
+		for (int r = 0; r < _rows; r ++){
+			for (int c = 0; c < _cols; c ++, addr ++){
+				for (int finder = 0; finder < _findersCount; finder ++){
+					if (finder < 64 && !boxes[finder].holds(r, c))
+						continue;
+					STATS(statsAdd(stats.engineCandidates[ENGINE_SCAN]));
+					WordPos pos = _finders[finder](this, word, len, addr, r, c);
+					if (pos.isValid())
+						return pos;
+				}
+			}
+		}
+		return WordPos();
+	}
+	/// Returns: bitmask of the first 64 finders that can not match word,
+	/// because their direction is missing one of word's bigrams. Finders
+	/// of unknown direction, or past the first 64, are never in the mask
+	unsigned long long _skipMask(const char *word){
+		unsigned long long skip = 0;
+		for (int finder = 0; finder < _findersCount && finder < 64; finder ++){
+			const int dir = _finderDirs[finder];
+			for (int i = 1; dir != -1 && word[i]; i ++){
+				const int a = word[i - 1] - 'A', b = word[i] - 'A';
+				if (b < 0 || b >= ALPHABETS || !(_bigrams[dir][a] & (1u << b))){
+					skip |= 1ull << finder;
+					break;
+				}
+			}
+		}
+		return skip;
+	}
+	/// find, trying finders only on cells with the first letter, and only
+	/// those finders whose direction has all the word's bigrams
+	WordPos _findIndexed(char *word){
+		const int first = word[0] - 'A';
+		if (first < 0 || first >= ALPHABETS || !_letterCells)
+			return _findScan(word);
+		const unsigned long long skip = _skipMask(word);
+		const int len = length(word);
+		FitBox boxes[64];
+		_fitBoxes(len, boxes);
+		STATS(ThreadStats &stats = threadStats());
+		for (int i = _letterStart[first]; i < _letterStart[first + 1]; i ++){
+			const int addr = _letterCells[i];
+			int r, c;
+			linAddr(addr, r, c);
+			for (int finder = 0; finder < _findersCount; finder ++){
+				if (finder < 64 && ((skip >> finder) & 1 || !boxes[finder].holds(r, c)))
+					continue;
+				STATS(statsAdd(stats.engineCandidates[ENGINE_INDEX]));
+				WordPos pos = _finders[finder](this, word, len, addr, r, c);
+				if (pos.isValid())
+					return pos;
+			}
+		}
+		return WordPos();
+	}
+public:
+	WordSearchGrid(){
+		_grid = nullptr;
+		_packed = nullptr;
+		_packedLayout = false;
+		_rows = _cols = _area = 0;
+
+		_finders = nullptr;
+		_finderDirs = nullptr;
+		_findersCount = 0;
+
+		_engine = ENGINE_INDEX;
+		_id = gridIdNext ++;
+		_version = 0;
+		_cache = nullptr;
+		_letterCells = nullptr;
+		_planes = nullptr;
+		_planeWords = 0;
+		_suffix = nullptr;
+		_suffixFile = nullptr;
+		_watched = nullptr;
+		_watchedCount = _watchedCapacity = 0;
+		_watchFunc = nullptr;
+		_watchData = nullptr;
+		_linesReady = _planesReady = _suffixReady = false;
+		for (int f = 0; f < LINE_FAMILIES; f ++){
+			_lines[f] = nullptr;
+			_lineOffset[f] = _lineAddr[f] = nullptr;
+			_linesLen[f] = _lineCount[f] = 0;
+		}
+	}
+	WordSearchGrid(const char *filename) : WordSearchGrid(){
+		fromFile(filename);
+	}
+	~WordSearchGrid(){
+		if (_grid)
+			delete[] _grid;
+		if (_packed)
+			delete[] _packed;
+		if (_finders)
+			delete[] _finders;
+		if (_finderDirs)
+			delete[] _finderDirs;
+		if (_letterCells)
+			delete[] _letterCells;
+		_freeLines();
+		_freePlanes();
+		_freeSuffix();
+		delete[] _suffixFile;
+		clearWatched();
+	}
+	/// engine used by find
+	SearchEngine engine(){
+		return _engine;
+	}
+	/// sets engine used by find, building whatever it needs
+	void setEngine(SearchEngine engine){
+		if (engine == _engine)
+			return;
+		_engine = engine;
+		_buildEngine();
+	}
+	/// builds the suffix index afresh, whatever the engine, and writes it
+	/// to the grid's .sa file unless that already holds it.
+	/// Must not be called while other threads use the grid.
+	///
+	/// Returns: false if it could not be built, or not written
+	bool buildSuffix(){
+		if (!_loaded())
+			return false;
+		_freeSuffix();
+		return _buildSuffix();
+	}
+	/// rows
+	int rows(){
+		return _rows;
+	}
+	/// columns
+	int cols(){
+		return _cols;
+	}
+	/// area
+	int area(){
+		return _area;
+	}
+	/// linear address
+	int linAddr(int r, int c){
+		return r * _cols + c;
+	}
+	/// linear address to r, c
+	void linAddr(int lin, int &r, int &c){
+		r = lin / _cols;
+		c = lin % _cols;
+	}
+	/// cell at address. In packed layout this is a copy, so changing it
+	/// does not change the grid
+	char &cell(int addr){
+		if (addr < 0 || addr >= _area){
+			_dummy = 0;
+			return _dummy;
+		}
+		if (_packedLayout){
+			_dummy = letter(addr);
+			return _dummy;
+		}
+		return _grid[addr];
+	}
+	/// Returns: the cells, row after row, or nullptr in packed layout
+	const char *cells(){
+		return _grid;
+	}
+	/// letter at address, in either layout. Address must be valid.
+	/// Unlike cell, this never writes anything, so it is safe to call from
+	/// many threads
+	char letter(int addr){
+		if (_packedLayout)
+			return 'A' + ((_packed[addr / PACKED_LETTERS] >>
+						(addr % PACKED_LETTERS * 5)) & 31);
+		return _grid[addr];
+	}
+	/// letter at r, c, in either layout
+	char letter(int r, int c){
+		return letter(linAddr(r, c));
+	}
+	/// copies letters of row r into row, which must have room for cols()
+	void unpackRow(int r, char *row){
+		for (int c = 0; c < _cols; c ++)
+			row[c] = letter(r, c);
+	}
+	/// if grid is stored as 5 bit letters
+	bool isPacked(){
+		return _packedLayout;
+	}
+	/// sets whether grid is stored as 5 bit letters, PACKED_LETTERS per
+	/// 64 bit word (a third less memory), or a byte per letter. Converts the
+	/// loaded grid, if any. Results are the same either way
+	void setPacked(bool packed){
+		if (packed == _packedLayout)
+			return;
+		if (packed && _grid)
+			_pack();
+		else if (!packed && _packed)
+			_unpack();
+		_packedLayout = packed;
+	}
+	/// if cells addr .. addr + len - 1 hold the letters of word (or of word
+	/// reversed). Packed layout only. Compares PACKED_LETTERS at a time
+	bool packedEquals(int addr, const char *word, int len, bool reversed){
+		for (int i = 0; i < len; i += PACKED_LETTERS){
+			const int n = len - i < PACKED_LETTERS ? len - i : PACKED_LETTERS;
+			unsigned long long chunk = 0;
+			for (int j = 0; j < n; j ++){
+				const char l = reversed ? word[len - 1 - i - j] : word[i + j];
+				chunk |= (unsigned long long)(l - 'A') << (5 * j);
+			}
+			unsigned long long diff = _packedWindow(addr + i) ^ chunk;
+			if (n < PACKED_LETTERS)
+				diff &= (1ull << (5 * n)) - 1;
+			if (diff)
+				return false;
+		}
+		return true;
+	}
+	/// cell at r, c
+	char &cell(int r, int c){
+		return cell(linAddr(r, c));
+	}
+	/// r, c of cell at offset in a line family's buffer. Line buffers must
+	/// be built (ENGINE_LINES)
+	void lineCell(int family, int offset, int &r, int &c){
+		// binary search for last line starting at or before offset
+		int lo = 0, hi = _lineCount[family] - 1;
+		while (lo < hi){
+			const int mid = (lo + hi + 1) / 2;
+			if (_lineOffset[family][mid] <= offset)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		const int along = offset - _lineOffset[family][lo];
+		linAddr(_lineAddr[family][lo], r, c);
+		r += along * FAMILY_R[family];
+		c += along * FAMILY_C[family];
+	}
+	/// Adds a finder function. dr, dc are the row & column step of the
+	/// direction it looks in, if it is one of DIR_R/DIR_C. Finders with
+	/// an unknown direction (0, 0) are never skipped by the index's bigram
+	/// check, but like all finders the index only calls them at cells
+	/// holding the word's first letter: a finder must only find words
+	/// starting at the address it is given
+	void addFinder(FinderFunc func, int dr = 0, int dc = 0){
+		FinderFunc *newArr = new FinderFunc[_findersCount + 1];
+		int *newDirs = new int[_findersCount + 1];
+		for (int i = 0; i < _findersCount; i ++){
+			newArr[i] = _finders[i];
+			newDirs[i] = _finderDirs[i];
+		}
+		newDirs[_findersCount] = -1;
+		for (int dir = 0; dir < DIRECTIONS; dir ++){
+			if (DIR_R[dir] == dr && DIR_C[dir] == dc)
+				newDirs[_findersCount] = dir;
+		}
+		newArr[_findersCount ++] = func;
+		delete[] _finders;
+		delete[] _finderDirs;
+		_finders = newArr;
+		_finderDirs = newDirs;
+		_version ++;
+	}
+	/// unique identity of this grid
+	unsigned long long id(){
+		return _id;
+	}
+	/// version of grid, incremented whenever results of find may change
+	unsigned long long version(){
+		return _version;
+	}
+	/// sets cache to use in front of find, or nullptr for none. Cache can
+	/// be shared between grids and threads
+	void setCache(ResultCache *cache){
+		_cache = cache;
+	}
+	/// passes every occurrence of word to func, in order of address then
+	/// finder, until func returns false. Uses the letter index if built
+	/// (ENGINE_INDEX), otherwise tries all cells. With ENGINE_SUFFIX,
+	/// occurrences come from the suffix index instead, in no particular
+	/// order, as if there were a finder for every direction.
+	///
+	/// Single letter words are reported once per cell rather than once per
+	/// finder. A palindrome is reported once per placement, rather than once
+	/// in each direction, when finders for both directions exist.
+	///
+	/// Returns: number of occurrences passed to func
+	int findAll(char *word, OccurrenceFunc func, void *data){
+		if (_engine == ENGINE_SUFFIX && _needSuffix())
+			return _suffix->findAll(word, func, data);
+		const int len = length(word);
+		if (len == 0)
+			return 0;
+		bool palindrome = true;
+		for (int i = 0; i < len / 2 && palindrome; i ++)
+			palindrome = word[i] == word[len - 1 - i];
+		// which directions have finders, for palindromes
+		bool hasDir[DIRECTIONS] = {false};
+		for (int finder = 0; finder < _findersCount; finder ++){
+			if (_finderDirs[finder] != -1)
+				hasDir[_finderDirs[finder]] = true;
+		}
+		const int first = word[0] - 'A';
+		const bool indexed = _engine == ENGINE_INDEX && _letterCells &&
+			first >= 0 && first < ALPHABETS;
+		const unsigned long long skip = indexed ? _skipMask(word) : 0;
+		FitBox boxes[64];
+		_fitBoxes(len, boxes);
+		const int end = indexed ? _letterStart[first + 1] : _area;
+		int count = 0;
+		int r = 0, c = -1;
+		for (int i = indexed ? _letterStart[first] : 0; i < end; i ++){
+			const int addr = indexed ? _letterCells[i] : i;
+			if (indexed)
+				linAddr(addr, r, c);
+			else if (++ c == _cols){
+				c = 0;
+				r ++;
+			}
+			for (int finder = 0; finder < _findersCount; finder ++){
+				if (finder < 64 && ((skip >> finder) & 1 || !boxes[finder].holds(r, c)))
+					continue;
+				WordPos pos = _finders[finder](this, word, len, addr, r, c);
+				if (!pos.isValid())
+					continue;
+				if (len == 1){
+					// same cell from every finder
+					count ++;
+					if (!func(pos, data))
+						return count;
+					break;
+				}
+				const int dir = _finderDirs[finder];
+				if (palindrome && dir != -1 && hasDir[dir ^ 1] &&
+						linAddr(pos.r1, pos.c1) > linAddr(pos.r2, pos.c2))
+					continue; // already reported from other end
+				count ++;
+				if (!func(pos, data))
+					return count;
+			}
+		}
+		return count;
+	}
+	/// Returns: number of occurrences of word, counting no further than
+	/// limit (if > 0). Occurrences are as in findAll
+	int count(char *word, int limit = 0){
+		int counted = 0;
+		CountLimit counter = {&counted, limit};
+		findAll(word, _countOccurrence, &counter);
+		return counted;
+	}
+	/// Returns: number of cell & direction pairs the grid reads prefix
+	/// from, without visiting each. -1 unless engine is ENGINE_SUFFIX
+	long long countPrefix(const char *prefix){
+		if (_engine != ENGINE_SUFFIX || !_needSuffix())
+			return -1;
+		return _suffix->countPrefix(prefix);
+	}
+	/// Returns: true if word occurs exactly once. Stops at second occurrence
+	bool isUnique(char *word){
+		return count(word, 2) == 1;
+	}
+	/// passes every placement matching pattern to func, like findAll.
+	/// Pattern has letters, `?` for any letter, and `[ABC]` for any one of
+	/// the letters in brackets (`[^ABC]` for any but those). Case does not
+	/// matter.
+	///
+	/// Uses the letter bitplanes, building them first if they are not
+	/// built.
+	///
+	/// Returns: number of placements passed to func, -1 if pattern is invalid
+	int findPattern(const char *pattern, OccurrenceFunc func, void *data){
+		const int maxLen = length(pattern);
+		unsigned int *classes = new unsigned int[maxLen + 1];
+		const int len = parsePattern(pattern, classes);
+		if (len <= 0){
+			delete[] classes;
+			return len == 0 ? 0 : -1;
+		}
+		_needPlanes();
+		const int count = _planeScan(classes, len, func, data);
+		delete[] classes;
+		return count;
+	}
+	/// finds the part of a line, in any direction, closest to word, with a
+	/// distance of at most maxDistance. Word must be sanitized and at most
+	/// 64 letters. Of equally close ones, the first found is returned.
+	///
+	/// Uses the line buffers, building them first if they are not built.
+	///
+	/// Returns: closest occurrence, with distance -1 if none
+	FuzzyPos findFuzzy(const char *word, int maxDistance, FuzzyMetric metric){
+		FuzzyPos best = {WordPos(), -1};
+		const int len = length(word);
+		if (len == 0 || len > 64 || maxDistance < 0 || !_loaded())
+			return best;
+		if (maxDistance >= len)
+			maxDistance = len - 1; // else an empty match would do
+		_needLines();
+		// pattern letters, forwards & reversed
+		char *rev = new char[len];
+		unsigned long long peq[2][ALPHABETS];
+		for (int i = 0; i < ALPHABETS; i ++)
+			peq[0][i] = peq[1][i] = 0;
+		for (int i = 0; i < len; i ++){
+			if (word[i] < 'A' || word[i] > 'Z'){
+				delete[] rev;
+				return best;
+			}
+			rev[len - 1 - i] = word[i];
+			peq[0][word[i] - 'A'] |= 1ull << i;
+			peq[1][word[i] - 'A'] |= 1ull << (len - 1 - i);
+		}
+		int limit = maxDistance + 1;
+		for (int f = 0; f < LINE_FAMILIES && limit > 0; f ++){
+			for (int line = 0; line < _lineCount[f] && limit > 0; line ++){
+				const char *text = _lines[f] + _lineOffset[f][line];
+				const int n = _lineOffset[f][line + 1] - _lineOffset[f][line] - 1;
+				for (int reversed = 0; reversed < 2 && limit > 0; reversed ++){
+					int end = -1, start;
+					const char *pattern = reversed ? rev : word;
+					const int distance = metric == FUZZY_HAMMING ?
+						_hammingLine(text, n, peq[reversed], len, limit, end) :
+						_levenshteinLine(text, n, peq[reversed], len, limit, end);
+					if (distance >= limit)
+						continue;
+					limit = distance;
+					start = metric == FUZZY_HAMMING ? end - len + 1 :
+						_levenshteinStart(text, end, pattern, len, distance);
+					if (reversed){
+						const int temp = start;
+						start = end;
+						end = temp;
+					}
+					int r, c;
+					linAddr(_lineAddr[f][line], r, c);
+					best.distance = distance;
+					best.pos = WordPos(r + start * FAMILY_R[f], c + start * FAMILY_C[f],
+							r + end * FAMILY_R[f], c + end * FAMILY_C[f]);
+				}
+			}
+		}
+		delete[] rev;
+		return best;
+	}
+	/// tries finding a word.
+	WordPos find(char *word){
+		STATS(StatsTimer timer(threadStats().findNs));
+		WordPos pos;
+		if (word[0] == 0)
+			return pos; // empty words are never found
+		if (_cache && _cache->get(_id, _version, word, pos))
+			return pos;
+		STATS(SearchEngine used = _engine);
+		if (_engine == ENGINE_INDEX)
+			pos = _findIndexed(word);
+		else if (_engine == ENGINE_LINES)
+			pos = _findLines(word);
+		else if (_engine == ENGINE_PLANES)
+			pos = _findPlanes(word);
+		else if (_engine == ENGINE_SUFFIX && _needSuffix())
+			pos = _suffix->find(word);
+		else{
+			pos = _findScan(word);
+			STATS(used = ENGINE_SCAN);
+		}
+		STATS(statsAdd(threadStats().engineFinds[used]));
+		STATS(if (pos.isValid()) statsAdd(threadStats().engineMatches[used]));
+		if (_cache)
+			_cache->put(_id, _version, word, pos);
+		return pos;
+	}
+	/// finds all words of an automaton in a single pass over every line of
+	/// the grid, forwards and backwards.
+	/// results must have room for automaton->count() items. Words not found
+	/// are left invalid.
+	///
+	/// Each word gets the same position find would give it, with finders
+	/// added in order of DIR_R/DIR_C
+	void solve(const WordAutomaton *automaton, WordPos *results){
+		const int count = automaton->count();
+		long long *best = new long long[count];
+		for (int i = 0; i < count; i ++)
+			best[i] = -1;
+		if (!_packedLayout){
+			solveRegion(automaton, _grid, _rows, _cols, 0, 0, _rows, best);
+			solveResults(automaton, best, _cols, results);
+			delete[] best;
+			return;
+		}
+		// unpack a band of rows at a time, overlapping like solveStreaming
+		const int overlap = automaton->maxLength() > 1 ? automaton->maxLength() - 1 : 0;
+		const int bandCap = STREAM_BAND_ROWS + overlap;
+		char *band = new char[(long long)bandCap * _cols];
+		for (int bandStart = 0; bandStart < _rows; bandStart += STREAM_BAND_ROWS){
+			const int loaded = _rows - bandStart < bandCap ? _rows - bandStart : bandCap;
+			for (int r = 0; r < loaded; r ++)
+				unpackRow(bandStart + r, band + (long long)r * _cols);
+			const int claimTo = bandStart + STREAM_BAND_ROWS >= _rows ?
+				loaded : STREAM_BAND_ROWS;
+			solveRegion(automaton, band, loaded, _cols, bandStart, 0, claimTo, best);
+		}
+		solveResults(automaton, best, _cols, results);
+		delete[] band;
+		delete[] best;
+	}
+	/// finds every word of a dictionary trie in the grid. From each cell, it
+	/// walks in each direction for as long as the trie has a matching prefix.
+	///
+	/// Every hit is passed to func. Single letter words are only reported
+	/// once per cell, rather than once per direction.
+	void findWords(const DictTrie *trie, WordHitFunc func, void *data){
+		for (int rStart = 0; rStart < _rows; rStart ++){
+			for (int cStart = 0; cStart < _cols; cStart ++){
+				for (int dir = 0; dir < DIRECTIONS; dir ++){
+					const int dr = DIR_R[dir], dc = DIR_C[dir];
+					int r = rStart, c = cStart, node = trie->root();
+					while (r >= 0 && r < _rows && c >= 0 && c < _cols){
+						node = trie->child(node, letter(r, c));
+						if (node == -1)
+							break;
+						const int word = trie->wordAt(node);
+						if (word != -1 && (dir == 0 || r != rStart || c != cStart))
+							func(word, WordPos(rStart, cStart, r, c), data);
+						r += dr, c += dc;
+					}
+				}
+			}
+		}
+	}
+	/// if all of str's n characters are letters. Branchless, so it can be
+	/// vectorized
+	static bool _allLetters(const char *str, long long n){
+		unsigned char bad = 0;
+		for (long long i = 0; i < n; i ++)
+			bad |= (unsigned char)((str[i] | 0x20) - 'a') >= ALPHABETS;
+		return !bad;
+	}
+	/// validates grid text and compacts it in place: line breaks are removed,
+	/// letters made uppercase. Lines end at \n or \r, empty ones are ignored.
+	/// Size of the grid is written to rows, cols and area.
+	///
+	/// Returns: false if invalid, with reason written to stderr
+	static bool _parse(char *buffer, long long len, int &rows, int &cols, int &area){
+		long long read = 0, write = 0;
+		int lineLength = -1, lineCount = 0;
+		while (read < len){
+			const char *newLine = (const char*)memchr(buffer + read, '\n', len - read);
+			long long end = newLine ? newLine - buffer : len;
+			if (!_allLetters(buffer + read, end - read)){
+				// either a \r line break, or a bad character
+				long long i = read;
+				while ((unsigned char)((buffer[i] | 0x20) - 'a') < ALPHABETS)
+					i ++;
+				if (buffer[i] != '\r'){
+					errors() << "Non alphabet character found. File is invalid.\n";
+					return false;
+				}
+				end = i;
+			}
+			const int currentLineLength = end - read;
+			if (currentLineLength){
+				if (lineLength == -1)
+					lineLength = currentLineLength;
+				if (lineLength != currentLineLength){
+					errors() << "Varying length lines found. File is invalid.\n";
+					return false;
+				}
+				memmove(buffer + write, buffer + read, currentLineLength);
+				for (long long i = write; i < write + currentLineLength; i ++)
+					buffer[i] &= ~0x20; // uppercase
+				write += currentLineLength;
+				lineCount ++;
+			}
+			read = end + 1;
+		}
+		cols = lineLength == -1 ? 0 : lineLength;
+		rows = lineCount;
+		area = write;
+		return true;
+	}
+	/// loads grid from file. The file is read with a single allocation, which
+	/// then holds the grid.
+	///
+	/// Returns: true if done, false if errored (reason written to stderr)
+	bool fromFile(const char *filename){
+		STATS(StatsTimer timer(threadStats().loadNs));
+		long long len;
+		char *buffer = readFile(filename, len);
+		if (!buffer)
+			return false;
+		return _load(buffer, len, filename);
+	}
+	/// loads grid from len bytes of text, in the same format as a file. The
+	/// suffix engine keeps its index in memory only.
+	///
+	/// Returns: true if done, false if errored (reason written to stderr)
+	bool fromText(const char *text, long long len){
+		char *buffer = new char[len + 1];
+		memcpy(buffer, text, len);
+		buffer[len] = 0;
+		return _load(buffer, len, nullptr);
+	}
+	/// loads grid from a buffer of len bytes of text, which it takes and
+	/// which then holds the grid. The suffix index file is filename.sa, or
+	/// none if filename is nullptr
+	///
+	/// Returns: true if done, false if errored (reason written to stderr)
+	bool _load(char *buffer, long long len, const char *filename){
+		if (_grid)
+			delete[] _grid;
+		_grid = nullptr;
+		delete[] _packed;
+		_packed = nullptr;
+		_rows = _cols = _area = 0;
+		_version ++;
+		// engine structures are of the old grid
+		_freeIndex();
+		_freeLines();
+		_freePlanes();
+		_freeSuffix();
+		delete[] _suffixFile;
+		_suffixFile = nullptr;
+		if (filename){
+			const int nameLen = length(filename);
+			_suffixFile = new char[nameLen + 4];
+			memcpy(_suffixFile, filename, nameLen);
+			memcpy(_suffixFile + nameLen, ".sa", 4);
+		}
+		if (!_parse(buffer, len, _rows, _cols, _area)){
+			delete[] buffer;
+			_rows = _cols = _area = 0;
+			// no grid, so watched words are not found
+			for (int i = 0; i < _watchedCount; i ++)
+				_watchedScan(i, true);
+			return false;
+		}
+		_grid = buffer;
+		if (_packedLayout)
+			_pack();
+		_buildEngine();
+		for (int i = 0; i < _watchedCount; i ++)
+			_watchedScan(i, true);
+		return true;
+	}
+	/// loads the cells of a grid file into a caller's buffer, grown as needed
+	/// by readFileInto, without making a grid of them. For going through many
+	/// grids with one buffer; cells are row major, rows x cols.
+	///
+	/// Returns: true if done, false if errored (reason written to stderr)
+	static bool loadCells(const char *filename, char *&buffer, long long &capacity,
+			int &rows, int &cols){
+		STATS(StatsTimer timer(threadStats().loadNs));
+		long long len;
+		int area;
+		if (!readFileInto(filename, buffer, capacity, len))
+			return false;
+		return _parse(buffer, len, rows, cols, area);
+	}
+	/// changes the letter of cell r, c. Updates the engine's structures and
+	/// those built on first use, only where they hold the cell, and
+	/// re-answers watched words by rechecking the segments through it. A
+	/// suffix index can not be updated, so it is dropped, and the next
+	/// search rebuilds the whole of it, in memory only: the index file
+	/// stays that of the grid's file.
+	/// Must not be called while other threads use the grid.
+	///
+	/// Returns: false if r, c is outside the grid or l is not a letter
+	bool setCell(int r, int c, char l){
+		if (l >= 'a' && l <= 'z')
+			l -= 'a' - 'A';
+		if (r < 0 || r >= _rows || c < 0 || c >= _cols || l < 'A' || l > 'Z')
+			return false;
+		const int addr = linAddr(r, c);
+		const int from = letter(addr) - 'A', to = l - 'A';
+		if (from == to)
+			return true;
+		if (_packedLayout){
+			const int shift = addr % PACKED_LETTERS * 5;
+			unsigned long long &word = _packed[addr / PACKED_LETTERS];
+			word = (word & ~(31ull << shift)) | ((unsigned long long)to << shift);
+		}else{
+			_grid[addr] = l;
+		}
+		_version ++;
+		if (_letterCells && _engine == ENGINE_INDEX)
+			_updateIndex(r, c, from, to);
+		if (_linesReady){
+			for (int f = 0; f < LINE_FAMILIES; f ++)
+				_lines[f][_lineOffsetOf(f, r, c)] = l;
+		}
+		if (_planesReady){
+			const unsigned long long bit = 1ull << (addr % 64);
+			_planes[from * _planeWords + addr / 64] &= ~bit;
+			_planes[to * _planeWords + addr / 64] |= bit;
+		}
+		_freeSuffix();
+		// the grid's file, and its index file, still hold the old letters
+		delete[] _suffixFile;
+		_suffixFile = nullptr;
+		_watchedUpdate(r, c);
+		return true;
+	}
+	/// watches a word (sanitized): its position is kept up to date by
+	/// setCell, as find would give it with a finder for every direction.
+	///
+	/// Returns: index of word among watched words
+	int watch(const char *word){
+		if (_watchedCount == _watchedCapacity){
+			_watchedCapacity = _watchedCapacity ? _watchedCapacity * 2 : SIZE_STEP;
+			Watched *watched = new Watched[_watchedCapacity];
+			for (int i = 0; i < _watchedCount; i ++)
+				watched[i] = _watched[i];
+			delete[] _watched;
+			_watched = watched;
+		}
+		Watched &watched = _watched[_watchedCount];
+		watched.len = length(word);
+		watched.word = new char[watched.len + 1];
+		memcpy(watched.word, word, watched.len + 1);
+		watched.keys = nullptr;
+		watched.count = watched.capacity = 0;
+		watched.pos = WordPos();
+		_watchedScan(_watchedCount, false);
+		return _watchedCount ++;
+	}
+	/// Returns: position of watched word at index, invalid if not in grid
+	WordPos watched(int index){
+		if (index < 0 || index >= _watchedCount)
+			return WordPos();
+		return _watched[index].pos;
+	}
+	/// sets function called by setCell with the index & new position of
+	/// every watched word whose position changed, or nullptr for none
+	void setWatchFunc(WordHitFunc func, void *data){
+		_watchFunc = func;
+		_watchData = data;
+	}
+	/// stops watching all words
+	void clearWatched(){
+		for (int i = 0; i < _watchedCount; i ++){
+			delete[] _watched[i].word;
+			delete[] _watched[i].keys;
+		}
+		delete[] _watched;
+		_watched = nullptr;
+		_watchedCount = _watchedCapacity = 0;
+	}
+	/// prints the grid
+	void print(){
+		for (int r = 0; r < _rows; r ++){
+			for (int c = 0; c < _cols; c ++)
+				std::cout << letter(r, c) << ' ';
+			std::cout << '\n';
+		}
+		std::cout << '\n';
+	}
+};
+
+/// finds word of len letters going (DR, DC) from addr, at r, c. Cells the
+/// word can not fit from are rejected before looking at any letter, and
+/// letters are then compared stepping a pointer through the grid
+template <int DR, int DC>
+WordPos finderDirection(WordSearchGrid *grid, char *word, int len, int addr, int r, int c){
+	STATS(const int dir = directionOf(DR, DC));
+	STATS(ThreadStats &stats = threadStats());
+	STATS(statsAdd(stats.invocations[dir]));
+	if (len == 0)
+		return WordPos(r, c, r - DR, c - DC);
+	const int rEnd = r + DR * (len - 1), cEnd = c + DC * (len - 1);
+	if (rEnd < 0 || rEnd >= grid->rows() || cEnd < 0 || cEnd >= grid->cols()){
+		STATS(statsAdd(stats.exitDepth[dir][0]));
+		return WordPos();
+	}
+	if (grid->letter(addr) != word[0]){
+		STATS(statsExit(stats, dir, 0));
+		return WordPos();
+	}
+	const char *cell = grid->cells();
+	if (cell){
+		const int stride = DR * grid->cols() + DC;
+		cell += addr;
+		for (int i = 1; i < len; i ++){
+			cell += stride;
+			if (*cell != word[i]){
+				STATS(statsExit(stats, dir, i));
+				return WordPos();
+			}
+		}
+	}else if (DR == 0){
+		// compared a word at a time, so depth is not known
+		if (!grid->packedEquals(DC > 0 ? addr : addr - len + 1, word, len, DC < 0)){
+			STATS(statsExit(stats, dir, 1));
+			return WordPos();
+		}
+	}else{
+		for (int i = 1; i < len; i ++){
+			if (grid->letter(r + DR * i, c + DC * i) != word[i]){
+				STATS(statsExit(stats, dir, i));
+				return WordPos();
+			}
+		}
+	}
+	STATS(statsAdd(stats.cellsVisited[dir], len));
+	STATS(statsAdd(stats.matches[dir]));
+	return WordPos(r, c, rEnd, cEnd);
+}
+
+/// finders of each direction, in order of DIR_R/DIR_C
+const FinderFunc finderHorizontalL2R = finderDirection<0, 1>;
+const FinderFunc finderHorizontalR2L = finderDirection<0, -1>;
+const FinderFunc finderVerticalU2D = finderDirection<1, 0>;
+const FinderFunc finderVerticalD2U = finderDirection<-1, 0>;
+const FinderFunc finderDiagonalUL2DR = finderDirection<1, 1>;
+const FinderFunc finderDiagonalDR2UL = finderDirection<-1, -1>;
+const FinderFunc finderDiagonalUR2DL = finderDirection<1, -1>;
+const FinderFunc finderDiagonalDL2UR = finderDirection<-1, 1>;
+
+/// what dictionary hits are written to
+struct DictOutput{
+	const DictTrie *trie;
+	std::ostream *stream;
+};
+
+/// writes a dictionary hit as: WORD {r1,c1},{r2,c2}
+void dictHitWrite(int word, WordPos pos, void *data){
+	DictOutput *out = (DictOutput*)data;
+	*out->stream << out->trie->word(word) << ' ' << pos << '\n';
+}
+
+/// finds every word of dictionary file in grid file, writes to outFilename
+int dictMain(const char *filename, const char *dictFilename, const char *outFilename){
+	DictTrie trie;
+	if (!trie.fromFile(dictFilename))
+		return 1;
+	std::ofstream file(outFilename);
+	if (!file){
+		errors() << "Failed to open output file " << outFilename << "\n";
+		return 1;
+	}
+	WordSearchGrid grid;
+	if (!grid.fromFile(filename))
+		return 1;
+	DictOutput out = {&trie, &file};
+	grid.findWords(&trie, dictHitWrite, &out);
+	return 0;
+}
+
+/// adds the finders for all 8 directions, in order of DIR_R/DIR_C
+void addDefaultFinders(WordSearchGrid &grid){
+	grid.addFinder(finderHorizontalL2R, 0, 1);
+	grid.addFinder(finderHorizontalR2L, 0, -1);
+	grid.addFinder(finderVerticalU2D, 1, 0);
+	grid.addFinder(finderVerticalD2U, -1, 0);
+	grid.addFinder(finderDiagonalUL2DR, 1, 1);
+	grid.addFinder(finderDiagonalDR2UL, -1, -1);
+	grid.addFinder(finderDiagonalUR2DL, 1, -1);
+	grid.addFinder(finderDiagonalDL2UR, -1, 1);
+}
+
+/// reads engine from its name (scan, index, lines, planes)
+///
+/// Returns: false if name is not known
+bool engineFromName(const char *name, SearchEngine &engine){
+	const char *names[] = {"scan", "index", "lines", "planes", "suffix"};
+	const SearchEngine engines[] = {ENGINE_SCAN, ENGINE_INDEX, ENGINE_LINES,
+		ENGINE_PLANES, ENGINE_SUFFIX};
+	for (int i = 0; i < 5; i ++){
+		if (stringEquals(name, names[i])){
+			engine = engines[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+/// splits a buffer into lines, in place. A \r before a line break is
+/// dropped. Empty lines are kept, so line i of the array is line i of the
+/// buffer; only text after the last line break is left out if empty
+///
+/// Returns: new array of lines
+char **splitLines(char *buffer, long long len, int &count){
+	count = 0;
+	for (long long i = 0; i < len; i ++)
+		count += buffer[i] == '\n';
+	char **lines = new char*[count + 1];
+	count = 0;
+	long long start = 0;
+	for (long long i = 0; i <= len; i ++){
+		if (i < len && buffer[i] != '\n')
+			continue;
+		buffer[i] = 0;
+		if (i > start && buffer[i - 1] == '\r')
+			buffer[i - 1] = 0;
+		if (i < len || buffer[start])
+			lines[count ++] = buffer + start;
+		start = i + 1;
+	}
+	return lines;
+}
+
+/// splits a buffer into lines, in place, like splitLines. Lines that
+/// sanitize to nothing are kept as empty queries, which are never found, so
+/// answers stay in line with the queries
+///
+/// Returns: new array of (sanitized) lines
+char **splitQueries(char *buffer, long long len, int &count){
+	char **queries = splitLines(buffer, len, count);
+	for (int i = 0; i < count; i ++)
+		sanitize(queries[i]);
+	return queries;
+}
+
+/// shared state of batch workers
+struct BatchJob{
+	WordSearchGrid *grid;
+	char **queries;
+	WordPos *results;
+	int count;
+	/// next query to be taken
+	std::atomic<int> next;
+};
+
+/// batch worker. Takes BATCH_CHUNK queries at a time until none are left
+void batchWorker(BatchJob *job){
+	while (true){
+		const int start = job->next.fetch_add(BATCH_CHUNK);
+		if (start >= job->count)
+			return;
+		const int end = start + BATCH_CHUNK < job->count ?
+			start + BATCH_CHUNK : job->count;
+		for (int i = start; i < end; i ++)
+			job->results[i] = job->grid->find(job->queries[i]);
+	}
+}
+
+/// finds every query (one per line) of queriesFilename in grid file, using
+/// threadsCount threads. Writes results to outFilename in query order.
+/// If cacheSize > 0, repeated queries are answered from a cache of that size
+int batchMain(const char *filename, const char *queriesFilename,
+		const char *outFilename, int threadsCount, SearchEngine engine,
+		int cacheSize){
+	long long len;
+	char *buffer = readFile(queriesFilename, len);
+	if (!buffer)
+		return 1;
+	std::ofstream file(outFilename);
+	if (!file){
+		errors() << "Failed to open output file " << outFilename << "\n";
+		delete[] buffer;
+		return 1;
+	}
+	WordSearchGrid grid;
+	grid.setEngine(engine);
+	if (!grid.fromFile(filename)){
+		delete[] buffer;
+		return 1;
+	}
+	addDefaultFinders(grid);
+	ResultCache *cache = cacheSize > 0 ? new ResultCache(cacheSize) : nullptr;
+	grid.setCache(cache);
+
+	BatchJob job;
+	job.grid = &grid;
+	job.queries = splitQueries(buffer, len, job.count);
+	job.results = new WordPos[job.count];
+	job.next = 0;
+	if (threadsCount < 1)
+		threadsCount = 1;
+	std::thread *threads = new std::thread[threadsCount];
+	for (int i = 0; i < threadsCount; i ++)
+		threads[i] = std::thread(batchWorker, &job);
+	for (int i = 0; i < threadsCount; i ++)
+		threads[i].join();
+	delete[] threads;
+
+	for (int i = 0; i < job.count; i ++){
+		if (job.results[i].isValid())
+			file << job.results[i] << '\n';
+		else
+			file << "Not found\n";
+	}
+	if (cache){
+		errors() << "cache: hits=" << cache->hits() << " misses=" << cache->misses()
+			<< " evictions=" << cache->evictions() << "\n";
+		delete cache;
+	}
+	delete[] job.results;
+	delete[] job.queries;
+	delete[] buffer;
+	return 0;
+}
+
+/// a grid kept resident by the server, and the number of requests using it
+struct RegistryEntry{
+	char *name;
+	WordSearchGrid *grid;
+	/// requests currently using grid
+	int refs;
+};
+
+/// named grids, shared between threads. Grids are only deleted once the
+/// last request using them is done, so unloading never pulls a grid out
+/// from under a find
+class GridRegistry{
+private:
+	RegistryEntry **_entries;
+	int _count;
+	int _capacity;
+	std::mutex _mutex;
+
+	/// Returns: index of entry with name, or -1. Must hold _mutex
+	int _indexOf(const char *name){
+		for (int i = 0; i < _count; i ++){
+			if (stringEquals(_entries[i]->name, name))
+				return i;
+		}
+		return -1;
+	}
+	/// frees an entry that nothing uses anymore
+	static void _free(RegistryEntry *entry){
+		delete[] entry->name;
+		delete entry->grid;
+		delete entry;
+	}
+public:
+	GridRegistry(){
+		_entries = nullptr;
+		_count = _capacity = 0;
+	}
+	~GridRegistry(){
+		for (int i = 0; i < _count; i ++)
+			_free(_entries[i]);
+		delete[] _entries;
+	}
+	/// adds (or replaces) a grid under name. Takes ownership of grid
+	void add(const char *name, WordSearchGrid *grid){
+		RegistryEntry *entry = new RegistryEntry;
+		const int nameLen = length(name);
+		entry->name = new char[nameLen + 1];
+		for (int i = 0; i <= nameLen; i ++)
+			entry->name[i] = name[i];
+		entry->grid = grid;
+		entry->refs = 1; // held by registry
+		std::lock_guard<std::mutex> lock(_mutex);
+		const int index = _indexOf(name);
+		if (index != -1){
+			RegistryEntry *old = _entries[index];
+			_entries[index] = entry;
+			if (-- old->refs == 0)
+				_free(old);
+			return;
+		}
+		if (_count == _capacity){
+			_capacity = _capacity ? _capacity * 2 : SIZE_STEP;
+			RegistryEntry **newArr = new RegistryEntry*[_capacity];
+			for (int i = 0; i < _count; i ++)
+				newArr[i] = _entries[i];
+			delete[] _entries;
+			_entries = newArr;
+		}
+		_entries[_count ++] = entry;
+	}
+	/// removes grid with name
+	/// Returns: false if there is no such grid
+	bool remove(const char *name){
+		std::lock_guard<std::mutex> lock(_mutex);
+		const int index = _indexOf(name);
+		if (index == -1)
+			return false;
+		RegistryEntry *entry = _entries[index];
+		_entries[index] = _entries[-- _count];
+		if (-- entry->refs == 0)
+			_free(entry);
+		return true;
+	}
+	/// Returns: entry for grid with name, or nullptr. Must be given back
+	/// with release
+	RegistryEntry *acquire(const char *name){
+		std::lock_guard<std::mutex> lock(_mutex);
+		const int index = _indexOf(name);
+		if (index == -1)
+			return nullptr;
+		_entries[index]->refs ++;
+		return _entries[index];
+	}
+	/// gives back an entry from acquire
+	void release(RegistryEntry *entry){
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (-- entry->refs == 0)
+			_free(entry);
+	}
+};
+
+/// Returns: next space separated token of str (0 terminated in place), and
+/// moves str past it. nullptr if none left
+char *nextToken(char *&str){
+	while (*str == ' ' || *str == '\t')
+		str ++;
+	if (*str == 0)
+		return nullptr;
+	char *token = str;
+	while (*str && *str != ' ' && *str != '\t')
+		str ++;
+	if (*str)
+		*(str ++) = 0;
+	return token;
+}
+
+/// a connection to the server
+struct ServerClient{
+	int fd;
+	/// received bytes not yet handled
+	char *in;
+	int inLen;
+	int inCap;
+	/// if a request of this client is being handled by a worker. Only one
+	/// is handled at a time, so responses come in order of requests
+	std::atomic<bool> busy;
+	/// responses not yet sent. Workers add to it, the polling thread sends
+	/// it as the socket takes it
+	char *out;
+	int outLen;
+	int outCap;
+	std::mutex outMutex;
+	/// if out was not empty when last sent from. Polling thread only
+	bool sending;
+	/// if client closed its end. Requests it sent before are still handled
+	bool eof;
+	/// if responses could not be sent, or piled up past SERVER_MAX_BACKLOG.
+	/// Client is dropped, unanswered
+	std::atomic<bool> failed;
+};
+
+/// a request for a worker
+struct ServerJob{
+	ServerClient *client;
+	char *line;
+	ServerJob *next;
+};
+
+/// resident solver, serving requests over a Unix domain socket. Requests
+/// are lines, each answered by one line:
+///
+/// * `LOAD name path [engine]` -> `OK`, or `ERROR reason`
+/// * `UNLOAD name` -> `OK`, or `ERROR reason`
+/// * `FIND name word` -> `{r1,c1},{r2,c2}`, `Not found`, or `ERROR reason`
+/// * `FUZZY name word [distance] [hamming|levenshtein]` -> closest
+///   `{r1,c1},{r2,c2} distance`, `Not found`, or `ERROR reason`
+/// * `CACHE` -> `hits=N misses=N evictions=N`
+///
+/// One thread polls all connections, and a pool of workers handle requests.
+/// Workers leave responses with the client for the polling thread to send,
+/// so a client that reads slowly holds up no worker
+class SolverServer{
+private:
+	GridRegistry _registry;
+	/// results cache, shared by all grids
+	ResultCache _cache;
+	/// listening socket
+	int _listenFd;
+	/// workers write to _wake[1] when done with a request, to wake poll
+	int _wake[2];
+
+	ServerClient **_clients;
+	int _clientsCount;
+	int _clientsCap;
+
+	/// queue of jobs
+	ServerJob *_head, *_tail;
+	std::mutex _queueMutex;
+	std::condition_variable _queueCond;
+
+	std::thread *_workers;
+	int _workersCount;
+
+	/// handles one request line
+	/// Returns: response line, in buffer
+	void _handle(char *line, char *response, int size){
+		char *rest = line;
+		const char *command = nextToken(rest);
+		const char *name = nextToken(rest);
+		if (command && stringEquals(command, "STATS")){
+#ifdef SOLVER_STATS
+			std::ostringstream json;
+			statsWriteJson(json);
+			snprintf(response, size, "%s", json.str().c_str());
+#else
+			snprintf(response, size, "ERROR built without SOLVER_STATS\n");
+#endif
+			return;
+		}
+		if (command && stringEquals(command, "CACHE")){
+			snprintf(response, size, "hits=%llu misses=%llu evictions=%llu\n",
+					_cache.hits(), _cache.misses(), _cache.evictions());
+			return;
+		}
+		if (command && name && stringEquals(command, "FIND")){
+			char *word = nextToken(rest);
+			RegistryEntry *entry = _registry.acquire(name);
+			if (!entry || !word){
+				snprintf(response, size, entry ? "ERROR no word\n" : "ERROR no such grid\n");
+				if (entry)
+					_registry.release(entry);
+				return;
+			}
+			sanitize(word);
+			WordPos pos = entry->grid->find(word);
+			_registry.release(entry);
+			if (pos.isValid())
+				snprintf(response, size, "{%d,%d},{%d,%d}\n", pos.r1, pos.c1, pos.r2, pos.c2);
+			else
+				snprintf(response, size, "Not found\n");
+			return;
+		}
+		if (command && name && stringEquals(command, "FUZZY")){
+			char *word = nextToken(rest);
+			const char *distance = nextToken(rest);
+			const char *metricName = nextToken(rest);
+			const FuzzyMetric metric = metricName && stringEquals(metricName, "hamming") ?
+				FUZZY_HAMMING : FUZZY_LEVENSHTEIN;
+			RegistryEntry *entry = _registry.acquire(name);
+			if (!entry || !word){
+				snprintf(response, size, entry ? "ERROR no word\n" : "ERROR no such grid\n");
+				if (entry)
+					_registry.release(entry);
+				return;
+			}
+			sanitize(word);
+			const FuzzyPos closest = entry->grid->findFuzzy(word,
+					distance ? atoi(distance) : FUZZY_MAX_DISTANCE, metric);
+			_registry.release(entry);
+			if (closest.distance != -1)
+				snprintf(response, size, "{%d,%d},{%d,%d} %d\n", closest.pos.r1,
+						closest.pos.c1, closest.pos.r2, closest.pos.c2, closest.distance);
+			else
+				snprintf(response, size, "Not found\n");
+			return;
+		}
+		if (command && name && stringEquals(command, "LOAD")){
+			const char *path = nextToken(rest);
+			const char *engineName = nextToken(rest);
+			SearchEngine engine = ENGINE_INDEX;
+			if (!path || (engineName && !engineFromName(engineName, engine))){
+				snprintf(response, size, "ERROR usage: LOAD name path [engine]\n");
+				return;
+			}
+			WordSearchGrid *grid = new WordSearchGrid;
+			grid->setEngine(engine);
+			if (!grid->fromFile(path)){
+				delete grid;
+				snprintf(response, size, "ERROR failed to load %s\n", path);
+				return;
+			}
+			addDefaultFinders(*grid);
+			grid->setCache(&_cache);
+			_registry.add(name, grid);
+			snprintf(response, size, "OK\n");
+			return;
+		}
+		if (command && name && stringEquals(command, "UNLOAD")){
+			snprintf(response, size, _registry.remove(name) ? "OK\n" : "ERROR no such grid\n");
+			return;
+		}
+		snprintf(response, size, "ERROR unknown request\n");
+	}
+	/// worker thread. Handles jobs until a nullptr client is queued
+	void _work(){
+		char response[SERVER_MAX_RESPONSE];
+		while (true){
+			ServerJob *job;
+			{
+				std::unique_lock<std::mutex> lock(_queueMutex);
+				while (!_head)
+					_queueCond.wait(lock);
+				job = _head;
+				_head = job->next;
+				if (!_head)
+					_tail = nullptr;
+			}
+			if (!job->client){
+				delete job;
+				return;
+			}
+			_handle(job->line, response, sizeof(response));
+			const int len = length(response);
+			if (len == 0 || response[len - 1] != '\n')
+				snprintf(response, sizeof(response), "ERROR response too long\n");
+			_respond(job->client, response, length(response));
+			delete[] job->line;
+			job->client->busy = false;
+			delete job;
+			const char wake = 0;
+			while (write(_wake[1], &wake, 1) < 0 && errno == EINTR){}
+		}
+	}
+	/// adds a response to client's unsent ones, for the polling thread to
+	/// send. Fails the client if too many pile up
+	void _respond(ServerClient *client, const char *response, int len){
+		std::lock_guard<std::mutex> lock(client->outMutex);
+		if (client->outLen + len > SERVER_MAX_BACKLOG){
+			client->failed = true; // not reading
+			return;
+		}
+		if (client->outLen + len > client->outCap){
+			int newCap = client->outCap * 2;
+			while (newCap < client->outLen + len)
+				newCap *= 2;
+			char *newOut = new char[newCap];
+			memcpy(newOut, client->out, client->outLen);
+			delete[] client->out;
+			client->out = newOut;
+			client->outCap = newCap;
+		}
+		memcpy(client->out + client->outLen, response, len);
+		client->outLen += len;
+	}
+	/// sends as much of client's unsent responses as its socket takes,
+	/// without waiting
+	void _send(ServerClient *client){
+		std::lock_guard<std::mutex> lock(client->outMutex);
+		int sent = 0;
+		while (sent < client->outLen){
+			const ssize_t got = send(client->fd, client->out + sent,
+					client->outLen - sent, MSG_NOSIGNAL);
+			if (got > 0){
+				sent += got;
+				continue;
+			}
+			if (got < 0 && errno == EINTR)
+				continue;
+			if (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+				client->failed = true; // gone
+				sent = client->outLen;
+			}
+			break;
+		}
+		client->outLen -= sent;
+		memmove(client->out, client->out + sent, client->outLen);
+		client->sending = client->outLen > 0;
+	}
+	/// closes client's connection and frees it
+	static void _free(ServerClient *client){
+		close(client->fd);
+		delete[] client->in;
+		delete[] client->out;
+		delete client;
+	}
+	/// queues a job
+	void _queue(ServerClient *client, char *line){
+		ServerJob *job = new ServerJob{client, line, nullptr};
+		std::lock_guard<std::mutex> lock(_queueMutex);
+		if (_tail)
+			_tail->next = job;
+		else
+			_head = job;
+		_tail = job;
+		_queueCond.notify_one();
+	}
+	/// hands client's next complete line to a worker, if it is not busy
+	void _dispatch(ServerClient *client){
+		if (client->busy || client->failed)
+			return;
+		const char *newLine = (const char*)memchr(client->in, '\n', client->inLen);
+		if (!newLine)
+			return;
+		const int lineLen = newLine - client->in;
+		char *line = new char[lineLen + 1];
+		for (int i = 0; i < lineLen; i ++)
+			line[i] = client->in[i] == '\r' ? ' ' : client->in[i];
+		line[lineLen] = 0;
+		client->inLen -= lineLen + 1;
+		memmove(client->in, newLine + 1, client->inLen);
+		client->busy = true;
+		_queue(client, line);
+	}
+	/// Returns: true if client's buffer is full, up to SERVER_MAX_LINE
+	static bool _inFull(ServerClient *client){
+		return client->inLen == client->inCap && client->inCap >= SERVER_MAX_LINE;
+	}
+	/// reads what client sent, as far as its buffer holds. The rest is left
+	/// with the socket until lines are taken out of the buffer
+	void _receive(ServerClient *client){
+		while (true){
+			if (client->inLen == client->inCap){
+				if (client->inCap >= SERVER_MAX_LINE){
+					// full. Only a line too long to ever fit is an error
+					if (!memchr(client->in, '\n', client->inLen))
+						client->eof = true;
+					return;
+				}
+				char *newIn = new char[client->inCap * 2];
+				memcpy(newIn, client->in, client->inLen);
+				delete[] client->in;
+				client->in = newIn;
+				client->inCap *= 2;
+			}
+			const ssize_t got = recv(client->fd, client->in + client->inLen,
+					client->inCap - client->inLen, 0);
+			if (got > 0){
+				client->inLen += got;
+				continue;
+			}
+			if (got < 0 && errno == EINTR)
+				continue;
+			if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+				client->eof = true;
+			return;
+		}
+	}
+	/// accepts a new connection
+	void _accept(){
+		const int fd = accept(_listenFd, nullptr, nullptr);
+		if (fd < 0)
+			return;
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		ServerClient *client = new ServerClient;
+		client->fd = fd;
+		client->inCap = SIZE_STEP * SIZE_STEP;
+		client->in = new char[client->inCap];
+		client->inLen = 0;
+		client->outCap = SIZE_STEP * SIZE_STEP;
+		client->out = new char[client->outCap];
+		client->outLen = 0;
+		client->sending = false;
+		client->busy = false;
+		client->eof = false;
+		client->failed = false;
+		if (_clientsCount == _clientsCap){
+			_clientsCap = _clientsCap ? _clientsCap * 2 : SIZE_STEP;
+			ServerClient **newArr = new ServerClient*[_clientsCap];
+			for (int i = 0; i < _clientsCount; i ++)
+				newArr[i] = _clients[i];
+			delete[] _clients;
+			_clients = newArr;
+		}
+		_clients[_clientsCount ++] = client;
+	}
+public:
+	SolverServer() : _cache(SERVER_CACHE_SIZE){
+		_listenFd = -1;
+		_wake[0] = _wake[1] = -1;
+		_clients = nullptr;
+		_clientsCount = _clientsCap = 0;
+		_head = _tail = nullptr;
+		_workers = nullptr;
+		_workersCount = 0;
+	}
+	~SolverServer(){
+		for (int i = 0; i < _workersCount; i ++)
+			_queue(nullptr, nullptr);
+		for (int i = 0; i < _workersCount; i ++)
+			_workers[i].join();
+		delete[] _workers;
+		for (int i = 0; i < _clientsCount; i ++)
+			_free(_clients[i]);
+		delete[] _clients;
+		if (_listenFd != -1)
+			close(_listenFd);
+		if (_wake[0] != -1){
+			close(_wake[0]);
+			close(_wake[1]);
+		}
+	}
+	/// starts listening on socket path, with workersCount workers
+	/// Returns: false if errored
+	bool start(const char *path, int workersCount){
+		sockaddr_un addr;
+		if (length(path) >= (int)sizeof(addr.sun_path)){
+			errors() << "Socket path too long " << path << "\n";
+			return false;
+		}
+		_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, path);
+		unlink(path);
+		if (_listenFd < 0 || bind(_listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+				listen(_listenFd, SOMAXCONN) < 0 || pipe(_wake) < 0){
+			errors() << "Failed to listen on " << path << "\n";
+			return false;
+		}
+		fcntl(_wake[0], F_SETFL, fcntl(_wake[0], F_GETFL) | O_NONBLOCK);
+		_workersCount = workersCount < 1 ? 1 : workersCount;
+		_workers = new std::thread[_workersCount];
+		for (int i = 0; i < _workersCount; i ++)
+			_workers[i] = std::thread(&SolverServer::_work, this);
+		return true;
+	}
+	/// loads a grid before serving
+	/// Returns: false if errored
+	bool load(const char *name, const char *path, SearchEngine engine){
+		WordSearchGrid *grid = new WordSearchGrid;
+		grid->setEngine(engine);
+		if (!grid->fromFile(path)){
+			delete grid;
+			return false;
+		}
+		addDefaultFinders(*grid);
+		grid->setCache(&_cache);
+		_registry.add(name, grid);
+		return true;
+	}
+	/// serves requests, forever
+	void run(){
+		pollfd *fds = nullptr;
+		int fdsCap = 0;
+		while (true){
+			const int count = _clientsCount + 2;
+			if (count > fdsCap){
+				delete[] fds;
+				fdsCap = count * 2;
+				fds = new pollfd[fdsCap];
+			}
+			fds[0] = {_listenFd, POLLIN, 0};
+			fds[1] = {_wake[0], POLLIN, 0};
+			// clients are only read from when they can take a request: not
+			// busy, with room in the buffer and not at EOF (which would be
+			// readable forever), and only written to when responses wait.
+			// Others are left out, as a negative fd, so what they send
+			// waits with the socket
+			for (int i = 0; i < _clientsCount; i ++){
+				ServerClient *client = _clients[i];
+				const bool reading = !client->eof && !client->failed &&
+					!client->busy && !_inFull(client);
+				const short events = (reading ? POLLIN : 0) |
+					(client->sending && !client->failed ? POLLOUT : 0);
+				fds[i + 2] = {events ? client->fd : -1, events, 0};
+			}
+			if (poll(fds, count, -1) < 0 && errno != EINTR)
+				break;
+			if (fds[1].revents){
+				char drain[SIZE_STEP * SIZE_STEP];
+				while (read(_wake[0], drain, sizeof(drain)) > 0){}
+			}
+			// read what came in, before new clients change indexes
+			for (int i = 0; i < count - 2; i ++){
+				if ((fds[i + 2].revents & ~POLLOUT) && !_clients[i]->eof)
+					_receive(_clients[i]);
+			}
+			if (fds[0].revents)
+				_accept();
+			for (int i = 0; i < _clientsCount; i ++){
+				ServerClient *client = _clients[i];
+				_dispatch(client);
+				_send(client);
+				// a worker may finish after _dispatch looked, so lines can
+				// be left even at EOF
+				if (!client->busy && (client->failed || (client->eof &&
+						!client->sending && !memchr(client->in, '\n', client->inLen)))){
+					_free(client);
+					_clients[i --] = _clients[-- _clientsCount];
+				}
+			}
+		}
+		delete[] fds;
+	}
+};
+
+/// runs the server on socket path. Optionally loads a grid named by the
+/// file name first
+int serveMain(const char *path, int threadsCount, int argc, char **argv){
+	SolverServer server;
+	for (int i = 0; i < argc; i ++){
+		if (!server.load(argv[i], argv[i], ENGINE_INDEX))
+			return 1;
+	}
+	if (!server.start(path, threadsCount))
+		return 1;
+	server.run();
+	return 0;
 }
 
-/// to store r1, c1, r2, c2
-struct WordPos{
-	int r1, c1, r2, c2;
-	WordPos(int r = -1, int c = -1, int rr = -1, int cc = -1){
-		r1 = r;
-		c1 = c;
-		r2 = rr;
-		c2 = cc;
+/// finds every query (one per line) of queriesFilename in grid file,
+/// streaming the grid in bands of bandRows rows rather than loading it.
+/// Writes results to outFilename in query order
+int streamMain(const char *filename, const char *queriesFilename,
+		const char *outFilename, int bandRows){
+	long long len;
+	char *buffer = readFile(queriesFilename, len);
+	if (!buffer)
+		return 1;
+	std::ofstream file(outFilename);
+	if (!file){
+		errors() << "Failed to open output file " << outFilename << "\n";
+		delete[] buffer;
+		return 1;
 	}
-	bool isValid(){
-		return r1 >= 0 && c1 >= 0 && r2 >= 0 && c2 >= 0;
+	int count;
+	char **queries = splitQueries(buffer, len, count);
+	WordAutomaton automaton;
+	for (int i = 0; i < count; i ++)
+		automaton.add(queries[i]);
+	automaton.build();
+	WordPos *results = new WordPos[count];
+	const bool done = solveStreaming(filename, &automaton, results, bandRows);
+	for (int i = 0; done && i < count; i ++){
+		if (results[i].isValid())
+			file << results[i] << '\n';
+		else
+			file << "Not found\n";
 	}
+	delete[] results;
+	delete[] queries;
+	delete[] buffer;
+	return done ? 0 : 1;
+}
+
+/// shared state of multi grid workers
+struct MultiJob{
+	const WordAutomaton *automaton;
+	char **grids;
+	int count;
+	/// directory results are written to
+	const char *outDir;
+	/// next grid to be taken
+	std::atomic<int> next;
+	/// grids that could not be loaded or written
+	std::atomic<int> failed;
 };
 
-std::ostream& operator<<(std::ostream& stream, const WordPos pos){
-	stream << '{' << pos.r1 << ',' << pos.c1 << "},{" <<
-		pos.r2 << ',' << pos.c2 << "}";
-	return stream;
-}
+/// multi grid worker. Takes one grid at a time until none are left, solving
+/// it with the shared automaton. The grid buffer, best matches and results
+/// are kept across grids, so a grid costs no allocations past the largest
+/// one seen so far
+void multiWorker(MultiJob *job){
+	const int count = job->automaton->count();
+	char *cells = nullptr;
+	long long capacity = 0;
+	long long *best = new long long[count];
+	WordPos *results = new WordPos[count];
+	char outFilename[4096];
+	std::ofstream file;
+	while (true){
+		const int index = job->next.fetch_add(1);
+		if (index >= job->count)
+			break;
+		const char *gridFilename = job->grids[index];
+		int rows, cols;
+		if (!WordSearchGrid::loadCells(gridFilename, cells, capacity, rows, cols)){
+			job->failed ++;
+			continue;
+		}
+		for (int i = 0; i < count; i ++)
+			best[i] = -1;
+		solveRegion(job->automaton, cells, rows, cols, 0, 0, rows, best);
+		solveResults(job->automaton, best, cols, results);
 
-/// sanitizes word (makes it uppercase, removes non alphabets)
-void sanitize(char* str){
-	if (str == nullptr)
-		return;
-	int len = length(str);
-	// first make it all uppercase
-	for (int i = 0; i < len; i ++){
-		if (str[i] >= 'a' && str[i] <= 'z')
-			str[i] -= 32;
-	}
-	// now remove non alphabets
-	int i = 0, shift = 0;
-	while (i + shift < len){
-		if (str[i + shift] >= 'A' && str[i + shift] <= 'Z'){
-			str[i] = str[i + shift];
-			i ++;
-		}else{
-			shift ++;
+		const char *name = strrchr(gridFilename, '/');
+		name = name ? name + 1 : gridFilename;
+		// numbered, as grids in different directories may share a name
+		snprintf(outFilename, sizeof(outFilename), "%s/%d-%s.out", job->outDir,
+				index, name);
+		file.open(outFilename);
+		if (!file){
+			errors() << "Failed to open output file " << outFilename << "\n";
+			file.clear();
+			job->failed ++;
+			continue;
+		}
+		for (int i = 0; i < count; i ++){
+			if (results[i].isValid())
+				file << results[i] << '\n';
+			else
+				file << "Not found\n";
+		}
+		file.close();
+		if (!file){
+			errors() << "Failed to write output file " << outFilename << "\n";
+			file.clear();
+			job->failed ++;
 		}
 	}
-	str[i] = 0;
+	delete[] cells;
+	delete[] best;
+	delete[] results;
 }
 
-/// changes character to uppercase
-/// 
-/// Returns: false if not an alphabet
-bool toUpper(char &c){
-	if (c >= 'a' && c <= 'z')
-		c -= 32;
-	return c >= 'A' && c <= 'Z';
-}
+/// finds every query (one per line) of queriesFilename in each grid file
+/// listed (one per line) in listFilename, using threadsCount threads. The
+/// queries are built into one automaton, shared by all threads. Results of a
+/// grid are written to outDir/<index>-<grid file name>.out, in query order,
+/// where index counts the grids listed from 0, skipping empty lines.
+///
+/// Returns: 0 if every grid was solved, 1 otherwise
+int multiMain(const char *queriesFilename, const char *listFilename,
+		const char *outDir, int threadsCount){
+	long long len, listLen;
+	char *buffer = readFile(queriesFilename, len);
+	if (!buffer)
+		return 1;
+	char *list = readFile(listFilename, listLen);
+	if (!list){
+		delete[] buffer;
+		return 1;
+	}
+	int count;
+	char **queries = splitQueries(buffer, len, count);
+	WordAutomaton automaton;
+	for (int i = 0; i < count; i ++)
+		automaton.add(queries[i]);
+	automaton.build();
 
-class WordSearchGrid;
+	MultiJob job;
+	job.automaton = &automaton;
+	job.grids = splitLines(list, listLen, job.count);
+	int listed = 0;
+	for (int i = 0; i < job.count; i ++){
+		if (job.grids[i][0])
+			job.grids[listed ++] = job.grids[i];
+	}
+	job.count = listed;
+	job.outDir = outDir;
+	job.next = 0;
+	job.failed = 0;
+	if (threadsCount < 1)
+		threadsCount = 1;
+	std::thread *threads = new std::thread[threadsCount];
+	for (int i = 0; i < threadsCount; i ++)
+		threads[i] = std::thread(multiWorker, &job);
+	for (int i = 0; i < threadsCount; i ++)
+		threads[i].join();
+	delete[] threads;
 
-/// prototype of function that is used to check if a word exists at an address
-/// the arguments passed are:
-/// * the grid
-/// * word
-/// * cell address
-typedef WordPos (*FinderFunc)(WordSearchGrid*, char*, int);
+	const int failed = job.failed;
+	if (failed)
+		errors() << failed << " of " << job.count << " grids failed\n";
+	delete[] job.grids;
+	delete[] queries;
+	delete[] list;
+	delete[] buffer;
+	return failed ? 1 : 0;
+}
 
-class WordSearchGrid{
-private:
-	/// the grid. 2D array mapped onto a 1D
-	char *_grid;
-	/// rows in grid
-	int _rows;
-	/// columns in grid
-	int _cols;
-	/// number of characters in grid (area)
-	int _area;
+/// writes a pattern match
+/// Returns: true
+bool patternMatchWrite(WordPos pos, void *data){
+	*(std::ostream*)data << pos << '\n';
+	return true;
+}
 
-	/// dummy
-	char _dummy;
+/// watched words of editMain
+struct EditWatch{
+	char **words;
+};
 
-	/// finder functions
-	FinderFunc *_finders;
-	/// number of finder functions
-	int _findersCount;
-public:
-	WordSearchGrid(){
-		_grid = nullptr;
-		_rows = _cols = _area = 0;
+/// writes a watched word's new position as: WORD {r1,c1},{r2,c2}
+void editWatchWrite(int index, WordPos pos, void *data){
+	EditWatch *watch = (EditWatch*)data;
+	std::cout << watch->words[index] << ' ';
+	if (pos.isValid())
+		std::cout << pos << '\n';
+	else
+		std::cout << "Not found\n";
+}
 
-		_finders = nullptr;
-		_findersCount = 0;
+/// watches the words of wordsFilename in a grid, then applies edits read
+/// from stdin, one "row col letter" per line, writing each watched word
+/// whose position changed after every edit
+int editMain(const char *filename, const char *wordsFilename){
+	long long len;
+	char *buffer = readFile(wordsFilename, len);
+	if (!buffer)
+		return 1;
+	WordSearchGrid grid;
+	if (!grid.fromFile(filename)){
+		delete[] buffer;
+		return 1;
 	}
-	WordSearchGrid(const char *filename){
-		_grid = nullptr;
-		_rows = _cols = _area = 0;
+	addDefaultFinders(grid);
+	int count;
+	EditWatch watch;
+	watch.words = splitQueries(buffer, len, count);
+	for (int i = 0; i < count; i ++){
+		const int index = grid.watch(watch.words[i]);
+		editWatchWrite(index, grid.watched(index), &watch);
+	}
+	grid.setWatchFunc(editWatchWrite, &watch);
+	int r, c;
+	char l;
+	while (std::cin >> r >> c >> l){
+		if (!grid.setCell(r, c, l))
+			errors() << "Invalid edit " << r << ' ' << c << ' ' << l << '\n';
+	}
+	delete[] watch.words;
+	delete[] buffer;
+	return 0;
+}
 
-		_finders = nullptr;
-		_findersCount = 0;
-		fromFile(filename);
+/// builds the suffix index of each grid file, if missing or stale, so
+/// later runs with ENGINE_SUFFIX only map it
+int indexMain(int count, char **filenames){
+	int failed = 0;
+	for (int i = 0; i < count; i ++){
+		WordSearchGrid grid;
+		grid.setEngine(ENGINE_SCAN);
+		if (!grid.fromFile(filenames[i])){
+			failed = 1;
+			continue;
+		}
+		if (!grid.buildSuffix()){
+			failed = 1; // reason already written
+			continue;
+		}
+		std::cout << filenames[i] << ".sa\n";
 	}
-	~WordSearchGrid(){
-		if (_grid)
-			delete[] _grid;
-		if (_finders)
-			delete[] _finders;
+	return failed;
+}
+
+/// writes every placement matching pattern in grid file to stdout
+int patternMain(const char *filename, const char *pattern){
+	WordSearchGrid grid;
+	grid.setEngine(ENGINE_PLANES);
+	if (!grid.fromFile(filename))
+		return 1;
+	const int count = grid.findPattern(pattern, patternMatchWrite, &std::cout);
+	if (count < 0){
+		errors() << "Invalid pattern " << pattern << "\n";
+		return 1;
 	}
-	/// rows
-	int rows(){
-		return _rows;
+	if (count == 0)
+		std::cout << "Not found\n";
+	return 0;
+}
+
+/// xorshift64* generator, so benchmark grids and queries come out the same
+/// on every platform for a given seed
+struct BenchRandom{
+	unsigned long long state;
+	unsigned long long next(){
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 2685821657736338717ull;
 	}
-	/// columns
-	int cols(){
-		return _cols;
+	/// Returns: random number in 0 .. n - 1
+	int below(int n){
+		return next() % n;
 	}
-	/// area
-	int area(){
-		return _area;
+};
+
+/// a kind of benchmark query set
+struct BenchQuerySet{
+	const char *name;
+	/// percent of queries that occur in the grid. The rest are read from the
+	/// grid too, but with a letter in their second half changed, so engines
+	/// get past the first letters before they fail. At these lengths such
+	/// words almost never occur elsewhere by chance
+	int hitPercent;
+	/// word lengths, inclusive
+	int minLen, maxLen;
+	/// bit per direction (index into DIR_R/DIR_C) that hits may go in
+	int dirMask;
+};
+
+const BenchQuerySet BENCH_QUERY_SETS[] = {
+	{"short", 100, 3, 5, 0xff},
+	{"long", 100, 12, 24, 0xff},
+	{"horizontal", 100, 4, 12, 0x03},
+	{"diagonal", 100, 4, 12, 0xf0},
+	{"half", 50, 8, 12, 0xff},
+	{"miss", 0, 8, 12, 0xff}
+};
+#define BENCH_QUERY_SETS_COUNT 6
+
+/// grid sizes benchmarked, as rows = cols
+const int BENCH_SIZES[] = {10, 100, 1000, 4000};
+#define BENCH_SIZES_COUNT 4
+
+/// an engine the benchmark runs, in a layout
+struct BenchEngine{
+	const char *name;
+	SearchEngine engine;
+	bool packed;
+};
+
+/// first one is the reference, the rest are checked against it
+const BenchEngine BENCH_ENGINES[] = {
+	{"scan", ENGINE_SCAN, false},
+	{"index", ENGINE_INDEX, false},
+	{"lines", ENGINE_LINES, false},
+	{"planes", ENGINE_PLANES, false},
+	{"index-packed", ENGINE_INDEX, true},
+	{"suffix", ENGINE_SUFFIX, false}
+};
+#define BENCH_ENGINES_COUNT 6
+
+/// Returns: seconds since some fixed point
+double benchNow(){
+	return std::chrono::duration<double>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// peak resident memory of the process so far, in KiB. Each engine is
+/// benchmarked in its own process, so this is per engine
+long benchPeakRss(){
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+	return usage.ru_maxrss;
+}
+
+int benchCompareDouble(const void *a, const void *b){
+	const double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+/// fills queries with count words of a query set, taken from grid
+void benchQueries(BenchRandom &random, const char *grid, int rows, int cols,
+		const BenchQuerySet &set, char **queries, int count){
+	for (int i = 0; i < count; i ++){
+		int len = set.minLen + random.below(set.maxLen - set.minLen + 1);
+		const bool miss = random.below(100) >= set.hitPercent;
+		int dir;
+		do
+			dir = random.below(DIRECTIONS);
+		while (!((set.dirMask >> dir) & 1));
+		const int dr = DIR_R[dir], dc = DIR_C[dir];
+		if (dr && len > rows)
+			len = rows;
+		if (dc && len > cols)
+			len = cols;
+		// start where the word fits
+		int r = random.below(dr ? rows - len + 1 : rows);
+		int c = random.below(dc ? cols - len + 1 : cols);
+		if (dr < 0)
+			r += len - 1;
+		if (dc < 0)
+			c += len - 1;
+		queries[i] = new char[len + 1];
+		for (int j = 0; j < len; j ++)
+			queries[i][j] = grid[(r + dr * j) * cols + c + dc * j];
+		queries[i][len] = 0;
+		if (miss){
+			// change a letter past the middle to a different one
+			const int j = len / 2 + random.below(len - len / 2);
+			queries[i][j] = 'A' + (queries[i][j] - 'A' + 1 +
+					random.below(BENCH_ALPHABETS - 1)) % BENCH_ALPHABETS;
+		}
 	}
-	/// linear address
-	int linAddr(int r, int c){
-		return r * _cols + c;
+}
+
+/// writes a benchmark record as a line of JSON
+void benchRecord(std::ostream &out, int size, unsigned long long seed,
+		const char *engine, const char *set, int count, double loadMs,
+		double buildMs, double *latencies, double totalSec, int checked,
+		int mismatches){
+	out << "{\"rows\":" << size << ",\"cols\":" << size << ",\"seed\":" << seed <<
+		",\"engine\":\"" << engine << "\",\"queries\":\"" << set <<
+		"\",\"count\":" << count << ",\"load_ms\":" << loadMs <<
+		",\"build_ms\":" << buildMs;
+	if (latencies){
+		qsort(latencies, count, sizeof(double), benchCompareDouble);
+		out << ",\"p50_us\":" << latencies[count / 2] * 1e6 <<
+			",\"p99_us\":" << latencies[count * 99 / 100] * 1e6;
+	}else{
+		out << ",\"p50_us\":null,\"p99_us\":null";
 	}
-	/// linear address to r, c
-	void linAddr(int lin, int &r, int &c){
-		r = lin / _cols;
-		c = lin % _cols;
+	out << ",\"qps\":" << (totalSec > 0 ? count / totalSec : 0) <<
+		",\"checked\":" << checked << ",\"mismatches\":" << mismatches <<
+		",\"peak_rss_kb\":" << benchPeakRss() << "}\n";
+}
+
+/// benchmarks an engine on every query set, writing a record for each.
+/// The reference engine runs only the checked queries, and writes its
+/// results to expected; others are checked against it
+///
+/// Returns: 0 if all results matched, 1 otherwise
+int benchEngine(std::ostream &out, const BenchEngine &engine, bool reference,
+		const char *gridFilename, int size, unsigned long long seed,
+		char ***queries, WordPos **expected, int count, int checked,
+		double *latencies, WordPos *results){
+	WordSearchGrid *searchGrid = new WordSearchGrid();
+	searchGrid->setEngine(ENGINE_SCAN);
+	searchGrid->setPacked(engine.packed);
+	double start = benchNow();
+	if (!searchGrid->fromFile(gridFilename)){
+		delete searchGrid;
+		return 1;
 	}
-	/// cell at address
-	char &cell(int addr){
-		if (addr < 0 || addr > _area){
-			_dummy = 0;
-			return _dummy;
+	const double loadMs = (benchNow() - start) * 1e3;
+	start = benchNow();
+	searchGrid->setEngine(engine.engine);
+	const double buildMs = (benchNow() - start) * 1e3;
+	addDefaultFinders(*searchGrid);
+	const int runCount = reference ? checked : count;
+	int failed = 0;
+	for (int q = 0; q < BENCH_QUERY_SETS_COUNT; q ++){
+		const double runStart = benchNow();
+		for (int i = 0; i < runCount; i ++){
+			const double queryStart = benchNow();
+			results[i] = searchGrid->find(queries[q][i]);
+			latencies[i] = benchNow() - queryStart;
 		}
-		return _grid[addr];
+		const double totalSec = benchNow() - runStart;
+		int mismatches = 0;
+		for (int i = 0; i < checked; i ++){
+			if (reference)
+				expected[q][i] = results[i];
+			else if (!(expected[q][i] == results[i]))
+				mismatches ++;
+		}
+		if (mismatches)
+			failed = 1;
+		benchRecord(out, size, seed, engine.name, BENCH_QUERY_SETS[q].name,
+				runCount, loadMs, buildMs, latencies, totalSec, checked, mismatches);
 	}
-	/// cell at r, c
-	char &cell(int r, int c){
-		return cell(linAddr(r, c));
+	delete searchGrid;
+	return failed;
+}
+
+/// benchmarks every engine, and solve, on fixed seed grids of each size up
+/// to maxSize. Every engine's results are checked against the scan engine,
+/// which only runs as many queries as it can in BENCH_SCAN_WORK. Engines
+/// past the reference run in a child process each, so their peak memory is
+/// their own; scan and solve share the parent's.
+///
+/// Returns: 0 if all engines agree, 1 otherwise
+int benchMain(const char *outFilename, int maxSize, unsigned long long seed){
+	std::ofstream file;
+	if (!stringEquals(outFilename, "-")){
+		file.open(outFilename);
+		if (!file){
+			errors() << "Failed to open output file " << outFilename << "\n";
+			return 1;
+		}
 	}
-	/// Adds a finder function
-	void addFinder(FinderFunc func){
-		FinderFunc *newArr = new FinderFunc[_findersCount + 1];
-		for (int i = 0; i < _findersCount; i ++)
-			newArr[i] = _finders[i];
-		newArr[_findersCount ++] = func;
-		delete[] _finders;
-		_finders = newArr;
+	std::ostream &out = stringEquals(outFilename, "-") ? std::cout : file;
+	char gridFilename[] = "/tmp/wordsearch_benchXXXXXX";
+	const int gridFd = mkstemp(gridFilename);
+	if (gridFd == -1){
+		errors() << "Failed to create benchmark grid file: " << strerror(errno) << "\n";
+		return 1;
 	}
-	/// tries finding a word.
-	WordPos find(char *word){
-		for (int addr = 0; addr < _area; addr ++){
-			for (int finder = 0; finder < _findersCount; finder ++){
-				WordPos pos = _finders[finder](this, word, addr);
-				if (pos.isValid())
-					return pos;
+	close(gridFd);
+	int failed = 0;
+	for (int s = 0; s < BENCH_SIZES_COUNT && BENCH_SIZES[s] <= maxSize; s ++){
+		const int size = BENCH_SIZES[s];
+		const long long area = (long long)size * size;
+		BenchRandom random = {seed * 0x9E3779B97F4A7C15ull + size};
+		char *grid = new char[area];
+		{
+			std::ofstream gridFile(gridFilename);
+			char *row = new char[size + 1];
+			for (int r = 0; r < size; r ++){
+				for (int c = 0; c < size; c ++)
+					row[c] = grid[(long long)r * size + c] = 'A' + random.below(BENCH_ALPHABETS);
+				row[size] = '\n';
+				gridFile.write(row, size + 1);
 			}
+			delete[] row;
 		}
-		return WordPos();
-	}
-	/// loads grid from file
-	void fromFile(const char *filename){
-		std::ifstream file(filename);
-		if (!file){
-			std::cerr << "Failed to open file " << filename << "\n";
-			exit(1);
+		long long countWanted = BENCH_WORK / area;
+		const int count = countWanted < BENCH_MIN_QUERIES ? BENCH_MIN_QUERIES :
+			countWanted > BENCH_MAX_QUERIES ? BENCH_MAX_QUERIES : countWanted;
+		countWanted = BENCH_SCAN_WORK / area;
+		const int checked = countWanted < BENCH_MIN_QUERIES ? BENCH_MIN_QUERIES :
+			countWanted > count ? count : countWanted;
+
+		char **queries[BENCH_QUERY_SETS_COUNT];
+		WordPos *expected[BENCH_QUERY_SETS_COUNT];
+		for (int q = 0; q < BENCH_QUERY_SETS_COUNT; q ++){
+			queries[q] = new char*[count];
+			expected[q] = new WordPos[checked];
+			benchQueries(random, grid, size, size, BENCH_QUERY_SETS[q], queries[q], count);
 		}
-		char *buffer = new char[SIZE_STEP];
-		int bufferCap = SIZE_STEP;
-		int bufferLen = 0;
+		double *latencies = new double[count];
+		WordPos *results = new WordPos[count];
 
-		int lineLength = -1, currentLineLength = 0, lineCount = 0;
-		while (!file.eof()){
-			char c;
-			file.get(c);
-			if (c == '\r' || c == '\n' || file.eof()){
-				if (currentLineLength == 0)
-					continue; // ignore empty lines
-				if (lineLength == -1)
-					lineLength = currentLineLength;
-				if (lineLength != currentLineLength){
-					std::cerr << "Varying length lines found. File is invalid.\n";
-					file.close();
-					delete[] buffer;
-					exit(1);
-				}
-				currentLineLength = 0;
+		for (int e = 0; e < BENCH_ENGINES_COUNT; e ++){
+			// the reference fills expected, so it runs here. The others run
+			// in a child process each, for their own peak memory
+			if (e == 0){
+				failed |= benchEngine(out, BENCH_ENGINES[e], true, gridFilename, size,
+						seed, queries, expected, count, checked, latencies, results);
 				continue;
 			}
-			if (!toUpper(c)){
-				// bad character
-				std::cerr << "Non alphabet character found. File is invalid.\n";
-				delete[] buffer;
-				exit(1);
+			out.flush();
+			const pid_t pid = fork();
+			if (pid == 0){
+				const int engineFailed = benchEngine(out, BENCH_ENGINES[e], false,
+						gridFilename, size, seed, queries, expected, count, checked,
+						latencies, results);
+				out.flush();
+				_exit(engineFailed);
 			}
-			if (++ currentLineLength == 1)
-				lineCount ++;
-			// append to buffer
-			if (bufferLen == bufferCap){
-				// grow
-				char *newBuf = new char[bufferCap + SIZE_STEP];
-				for (int i = 0; i < bufferCap; i ++)
-					newBuf[i] = buffer[i];
-				delete[] buffer;
-				buffer = newBuf;
-				bufferCap += SIZE_STEP;
-			}
-			buffer[bufferLen ++] = c;
+			int status;
+			if (pid == -1 || waitpid(pid, &status, 0) != pid ||
+					!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				failed = 1;
 		}
-		file.close();
-		_cols = lineLength;
-		_rows = lineCount;
-		_area = bufferLen;
-		if (_cols * _rows != _area){
-			std::cerr << "Varying length lines found. File is invalid.\n";
-			delete[] buffer;
-			exit(1);
-		}
-		if (_area == bufferCap){
-			_grid = buffer;
+
+		// solve answers a whole query set at once, so it has no per query latency
+		WordSearchGrid *searchGrid = new WordSearchGrid();
+		searchGrid->setEngine(ENGINE_SCAN);
+		double start = benchNow();
+		if (searchGrid->fromFile(gridFilename)){
+			const double loadMs = (benchNow() - start) * 1e3;
+			for (int q = 0; q < BENCH_QUERY_SETS_COUNT; q ++){
+				start = benchNow();
+				WordAutomaton automaton;
+				for (int i = 0; i < count; i ++)
+					automaton.add(queries[q][i]);
+				automaton.build();
+				const double buildMs = (benchNow() - start) * 1e3;
+				start = benchNow();
+				searchGrid->solve(&automaton, results);
+				const double totalSec = benchNow() - start;
+				int mismatches = 0;
+				for (int i = 0; i < checked; i ++){
+					if (!(expected[q][i] == results[i]))
+						mismatches ++;
+				}
+				if (mismatches)
+					failed = 1;
+				benchRecord(out, size, seed, "solve", BENCH_QUERY_SETS[q].name,
+						count, loadMs, buildMs, nullptr, totalSec, checked, mismatches);
+			}
 		}else{
-			_grid = new char[_area];
-			for (int i = 0; i < _area; i ++)
-				_grid[i] = buffer[i];
-			delete[] buffer;
+			failed = 1;
 		}
-	}
-	/// prints the grid
-	void print(){
-		for (int r = 0; r < _rows; r ++){
-			const int rowOffset = r * _cols;
-			for (int c = 0; c < _cols; c ++)
-				std::cout << _grid[rowOffset + c] << ' ';
-			std::cout << '\n';
+		delete searchGrid;
+
+		for (int q = 0; q < BENCH_QUERY_SETS_COUNT; q ++){
+			for (int i = 0; i < count; i ++)
+				delete[] queries[q][i];
+			delete[] queries[q];
+			delete[] expected[q];
 		}
-		std::cout << '\n';
+		delete[] latencies;
+		delete[] results;
+		delete[] grid;
 	}
+	unlink(gridFilename);
+	char suffixFilename[sizeof(gridFilename) + 3];
+	snprintf(suffixFilename, sizeof(suffixFilename), "%s.sa", gridFilename);
+	unlink(suffixFilename);
+	if (failed)
+		errors() << "Engines disagree, see mismatches\n";
+	return failed;
+}
+
+/// a grid opened through the C interface
+struct WsGrid{
+	WordSearchGrid grid;
 };
 
-WordPos finderHorizontalL2R(WordSearchGrid *grid, char *word, int addr){
-	const int len = length(word);
-	int r, c;
-	grid->linAddr(addr, r, c);
-	const int cStart = c;
-	int count = 0;
-	while (count < len && c < grid->cols()){
-		if (grid->cell(r, c) != word[count])
-			break;
-		count ++, c ++;
+/// opens text (of a file, if filename is not nullptr) as a grid
+WsError wsGridLoad(const char *filename, const char *text, long long len,
+		WsGrid **grid){
+	if (!grid || (!filename && (!text || len < 0)))
+		return WS_ERR_ARGUMENT;
+	if (filename && access(filename, R_OK) != 0)
+		return WS_ERR_FILE;
+	ErrorsMuted muted;
+	WsGrid *opened = new WsGrid;
+	addDefaultFinders(opened->grid);
+	if (!(filename ? opened->grid.fromFile(filename) :
+			opened->grid.fromText(text, len))){
+		delete opened;
+		return WS_ERR_INVALID;
 	}
-	if (count < len)
-		return WordPos();
-	return WordPos(r, cStart, r, c - 1);
+	*grid = opened;
+	return WS_OK;
 }
 
-WordPos finderHorizontalR2L(WordSearchGrid *grid, char *word, int addr){
-	const int len = length(word);
-	int r, c;
-	grid->linAddr(addr, r, c);
-	const int cStart = c;
-	int count = 0;
-	while (count < len && c >= 0){
-		if (grid->cell(r, c) != word[count])
-			break;
-		count ++, c --;
-	}
-	if (count < len)
-		return WordPos();
-	return WordPos(r, cStart, r, c + 1);
+WsError wsGridOpen(const char *filename, WsGrid **grid){
+	if (!filename)
+		return WS_ERR_ARGUMENT;
+	return wsGridLoad(filename, nullptr, 0, grid);
 }
 
-WordPos finderVerticalU2D(WordSearchGrid *grid, char *word, int addr){
-	const int len = length(word);
-	int r, c;
-	grid->linAddr(addr, r, c);
-	const int rStart = r;
-	int count = 0;
-	while (count < len && r < grid->rows()){
-		if (grid->cell(r, c) != word[count])
-			break;
-		count ++, r ++;
-	}
-	if (count < len)
-		return WordPos();
-	return WordPos(rStart, c, r - 1, c);
+WsError wsGridFromText(const char *text, long long len, WsGrid **grid){
+	return wsGridLoad(nullptr, text, len, grid);
 }
 
-WordPos finderVerticalD2U(WordSearchGrid *grid, char *word, int addr){
-	const int len = length(word);
-	int r, c;
-	grid->linAddr(addr, r, c);
-	const int rStart = r;
-	int count = 0;
-	while (count < len && r >= 0){
-		if (grid->cell(r, c) != word[count])
-			break;
-		count ++, r --;
-	}
-	if (count < len)
-		return WordPos();
-	return WordPos(rStart, c, r + 1, c);
+void wsGridClose(WsGrid *grid){
+	delete grid;
 }
 
-WordPos finderDiagonalUL2DR(WordSearchGrid *grid, char *word, int addr){
-	const int len = length(word);
-	int r, c;
-	grid->linAddr(addr, r, c);
-	const int rStart = r, cStart = c;
-	int count = 0;
-	while (count < len && r < grid->rows() && c < grid->cols()){
-		if (grid->cell(r, c) != word[count])
-			break;
-		count ++, r ++, c ++;
-	}
-	if (count < len)
-		return WordPos();
-	return WordPos(rStart, cStart, r - 1, c - 1);
+int wsGridRows(WsGrid *grid){
+	return grid ? grid->grid.rows() : 0;
 }
 
-WordPos finderDiagonalDR2UL(WordSearchGrid *grid, char *word, int addr){
-	const int len = length(word);
-	int r, c;
-	grid->linAddr(addr, r, c);
-	const int rStart = r, cStart = c;
-	int count = 0;
-	while (count < len && r >= 0 && c >= 0){
-		if (grid->cell(r, c) != word[count])
-			break;
-		count ++, r --, c --;
-	}
-	if (count < len)
-		return WordPos();
-	return WordPos(rStart, cStart, r + 1, c + 1);
+int wsGridCols(WsGrid *grid){
+	return grid ? grid->grid.cols() : 0;
 }
 
-WordPos finderDiagonalUR2DL(WordSearchGrid *grid, char *word, int addr){
+WsError wsGridFind(WsGrid *grid, const char *word, WsPos *pos){
+	if (!grid || !word || !pos)
+		return WS_ERR_ARGUMENT;
 	const int len = length(word);
-	int r, c;
-	grid->linAddr(addr, r, c);
-	const int rStart = r, cStart = c;
-	int count = 0;
-	while (count < len && r < grid->rows() && c >= 0){
-		if (grid->cell(r, c) != word[count])
-			break;
-		count ++, r ++, c --;
+	char *sanitized = new char[len + 1];
+	memcpy(sanitized, word, len + 1);
+	sanitize(sanitized);
+	if (!sanitized[0]){
+		// nothing left to find
+		delete[] sanitized;
+		pos->r1 = pos->c1 = pos->r2 = pos->c2 = -1;
+		return WS_OK;
 	}
-	if (count < len)
-		return WordPos();
-	return WordPos(rStart, cStart, r - 1, c + 1);
+	ErrorsMuted muted;
+	const WordPos found = grid->grid.find(sanitized);
+	delete[] sanitized;
+	pos->r1 = found.r1;
+	pos->c1 = found.c1;
+	pos->r2 = found.r2;
+	pos->c2 = found.c2;
+	return WS_OK;
 }
 
-WordPos finderDiagonalDL2UR(WordSearchGrid *grid, char *word, int addr){
-	const int len = length(word);
-	int r, c;
-	grid->linAddr(addr, r, c);
-	const int rStart = r, cStart = c;
-	int count = 0;
-	while (count < len && r >= 0 && c < grid->cols()){
-		if (grid->cell(r, c) != word[count])
-			break;
-		count ++, r --, c ++;
+WsError wsGridSolve(WsGrid *grid, const char *const *words, int count,
+		const WsAllocator *allocator, WsPos **results){
+	if (!grid || !words || count < 0 || !results)
+		return WS_ERR_ARGUMENT;
+	for (int i = 0; i < count; i ++){
+		if (!words[i])
+			return WS_ERR_ARGUMENT;
 	}
-	if (count < len)
-		return WordPos();
-	return WordPos(rStart, cStart, r + 1, c - 1);
+	WsPos *out = (WsPos*)wsAllocate(allocator, sizeof(WsPos) * (count ? count : 1));
+	if (!out)
+		return WS_ERR_MEMORY;
+	ErrorsMuted muted;
+	WordAutomaton automaton;
+	for (int i = 0; i < count; i ++){
+		const int len = length(words[i]);
+		char *sanitized = new char[len + 1];
+		memcpy(sanitized, words[i], len + 1);
+		sanitize(sanitized);
+		automaton.add(sanitized);
+		delete[] sanitized;
+	}
+	automaton.build();
+	WordPos *found = new WordPos[count];
+	grid->grid.solve(&automaton, found);
+	for (int i = 0; i < count; i ++){
+		out[i].r1 = found[i].r1;
+		out[i].c1 = found[i].c1;
+		out[i].r2 = found[i].r2;
+		out[i].c2 = found[i].c2;
+	}
+	delete[] found;
+	*results = out;
+	return WS_OK;
 }
 
+#ifndef WORDSEARCH_LIBRARY
 int main(int argc, char **argv){
+	STATS(atexit(statsAtExit));
+	if (argc >= 5 && stringEquals(argv[1], "--dict"))
+		return dictMain(argv[2], argv[3], argv[4]);
+	if (argc >= 5 && stringEquals(argv[1], "--stream")){
+		// --stream grid queries output [band rows]
+		return streamMain(argv[2], argv[3], argv[4],
+				argc >= 6 ? atoi(argv[5]) : STREAM_BAND_ROWS);
+	}
+	if (argc >= 5 && stringEquals(argv[1], "--multi")){
+		// --multi queries grid list output directory [threads]
+		return multiMain(argv[2], argv[3], argv[4], argc >= 6 ?
+				atoi(argv[5]) : std::thread::hardware_concurrency());
+	}
+	if (argc >= 2 && stringEquals(argv[1], "--bench")){
+		// --bench [output, - for stdout] [max size] [seed]
+		return benchMain(argc >= 3 ? argv[2] : "-",
+				argc >= 4 ? atoi(argv[3]) : BENCH_SIZES[BENCH_SIZES_COUNT - 1],
+				argc >= 5 ? strtoull(argv[4], nullptr, 10) : 1);
+	}
+	if (argc >= 4 && stringEquals(argv[1], "--edit"))
+		return editMain(argv[2], argv[3]);
+	if (argc >= 3 && stringEquals(argv[1], "--index"))
+		return indexMain(argc - 2, argv + 2);
+	if (argc >= 4 && stringEquals(argv[1], "--pattern"))
+		return patternMain(argv[2], argv[3]);
+	if (argc >= 5 && stringEquals(argv[1], "--batch")){
+		// --batch grid queries output [threads] [engine] [cache size]
+		int threads = std::thread::hardware_concurrency(), cacheSize = 0;
+		SearchEngine engine = ENGINE_INDEX;
+		if (argc >= 6)
+			threads = atoi(argv[5]);
+		if (argc >= 7 && !engineFromName(argv[6], engine)){
+			errors() << "Unknown engine " << argv[6] << "\n";
+			return 1;
+		}
+		if (argc >= 8)
+			cacheSize = atoi(argv[7]);
+		return batchMain(argv[2], argv[3], argv[4], threads, engine, cacheSize);
+	}
+	if (argc >= 3 && stringEquals(argv[1], "--serve")){
+		// --serve socket [threads] [grid files to load...]
+		int threads = std::thread::hardware_concurrency();
+		if (argc >= 4)
+			threads = atoi(argv[3]);
+		return serveMain(argv[2], threads, argc - 4 > 0 ? argc - 4 : 0, argv + 4);
+	}
 	const char *filename = "input.txt", *outFilename = "output.txt";
-	if (argc >= 1)
-		filename = argv[1];
 	if (argc >= 2)
+		filename = argv[1];
+	if (argc >= 3)
 		outFilename = argv[2];
 	std::ofstream file(outFilename);
 	if (!file){
 		std::cout << "Failed to open output file " << outFilename << "\n";
-		exit(1);
+		return 1;
 	}
 	// get row/cols, and ignore them
 	int n;
 	std::cout << "enter 2 values for size, (that I will ignore anyways): ";
 	std::cin >> n >> n;
 
-	WordSearchGrid grid(filename);
-	grid.addFinder(finderHorizontalL2R);
-	grid.addFinder(finderHorizontalR2L);
-	grid.addFinder(finderVerticalU2D);
-	grid.addFinder(finderVerticalD2U);
-	grid.addFinder(finderDiagonalUL2DR);
-	grid.addFinder(finderDiagonalDR2UL);
-	grid.addFinder(finderDiagonalUR2DL);
-	grid.addFinder(finderDiagonalDL2UR);
+	WordSearchGrid grid;
+	if (!grid.fromFile(filename))
+		return 1;
+	addDefaultFinders(grid);
 	std::cout << "grid is:\n";
 	grid.print();
 
@@ -418,9 +4985,14 @@ int main(int argc, char **argv){
 		}else{
 			std::cout << "Not found\n";
 			file << "Not found\n";
+			FuzzyPos closest = grid.findFuzzy(buffer, FUZZY_MAX_DISTANCE, FUZZY_LEVENSHTEIN);
+			if (closest.distance != -1)
+				std::cout << "Closest: " << closest.pos << " (distance " <<
+					closest.distance << ")\n";
 		}
 	}
 
 	delete[] buffer;
 	return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,158 @@
+/// Shared by the generator (question_1.cpp) and the solver (question_2.cpp):
+/// string helpers both use, and the C interface to both, for calling them
+/// in-process as a library.
+///
+/// Either file compiled with WORDSEARCH_LIBRARY defined leaves out its main,
+/// so both can be built into one library:
+///
+/// g++ -std=c++17 -O2 -pthread -shared -fPIC -DWORDSEARCH_LIBRARY
+///     question_1.cpp question_2.cpp -o libwordsearch.so
+///
+/// Nothing in the library exits the process or uses global state besides
+/// atomics: every call works on its own objects, so calls from different
+/// threads do not interfere. Calls report errors through WsError only, and
+/// write nothing to the host's stderr.
+#ifndef WORDSEARCH_H
+#define WORDSEARCH_H
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/// result of a call through the C interface
+typedef enum WsError{
+	WS_OK = 0,
+	/// an argument was null or out of range
+	WS_ERR_ARGUMENT = 1,
+	/// a file could not be opened or read
+	WS_ERR_FILE = 2,
+	/// grid text is not a valid grid
+	WS_ERR_INVALID = 3,
+	/// generator found no grid that holds all words
+	WS_ERR_NO_GRID = 4,
+	/// the allocator returned null
+	WS_ERR_MEMORY = 5
+} WsError;
+
+/// allocator for memory handed to the caller. A null WsAllocator means
+/// malloc and free. data is passed on to both functions
+typedef struct WsAllocator{
+	void *(*alloc)(size_t size, void *data);
+	void (*release)(void *ptr, void *data);
+	void *data;
+} WsAllocator;
+
+/// position of a word: first letter at r1, c1, last at r2, c2. All -1 if
+/// not found
+typedef struct WsPos{
+	int r1, c1, r2, c2;
+} WsPos;
+
+/// a grid opened for solving. Opaque
+typedef struct WsGrid WsGrid;
+
+/// allocates size bytes with allocator (or malloc if null)
+static inline void *wsAllocate(const WsAllocator *allocator, size_t size){
+	return allocator ? allocator->alloc(size, allocator->data) : malloc(size);
+}
+
+/// frees memory from wsAllocate with the same allocator
+static inline void wsRelease(const WsAllocator *allocator, void *ptr){
+	if (allocator)
+		allocator->release(ptr, allocator->data);
+	else
+		free(ptr);
+}
+
+/// generates a grid holding count words, from seed. Up to maxIterations
+/// (0 for default) iterations are tried. On success, *grid is set to
+/// (*len) * (*len) letters, row major and not null terminated, allocated
+/// with allocator
+WsError wsGenerate(const char *const *words, int count, unsigned int seed,
+		int maxIterations, const WsAllocator *allocator, char **grid, int *len);
+
+/// opens a grid file for solving
+WsError wsGridOpen(const char *filename, WsGrid **grid);
+/// opens a grid from len bytes of text, in the same format as grid files
+WsError wsGridFromText(const char *text, long long len, WsGrid **grid);
+/// closes a grid. No search may be running on it
+void wsGridClose(WsGrid *grid);
+/// Returns: number of rows, or columns, of grid
+int wsGridRows(WsGrid *grid);
+int wsGridCols(WsGrid *grid);
+/// finds a word in grid. A grid can be searched from many threads at once.
+/// *pos is all -1 if not found
+WsError wsGridFind(WsGrid *grid, const char *word, WsPos *pos);
+/// finds count words in grid, in one pass. On success, *results is set to
+/// count positions, in word order, allocated with allocator
+WsError wsGridSolve(WsGrid *grid, const char *const *words, int count,
+		const WsAllocator *allocator, WsPos **results);
+
+#ifdef __cplusplus
+}
+
+#include <iostream>
+
+/// Returns: pointer to the stream this thread writes errors to, std::cerr
+/// unless set otherwise
+inline std::ostream *&errorsTarget(){
+	thread_local std::ostream *target = &std::cerr;
+	return target;
+}
+
+/// Returns: stream this thread writes errors to
+inline std::ostream &errors(){
+	return *errorsTarget();
+}
+
+/// discards this thread's errors for as long as it lives. The C interface
+/// holds one for each call, as it reports errors through WsError only
+struct ErrorsMuted{
+	std::ostream *previous;
+	ErrorsMuted(){
+		// a stream with no buffer fails every write, writing nothing
+		thread_local std::ostream discard(nullptr);
+		previous = errorsTarget();
+		errorsTarget() = &discard;
+	}
+	~ErrorsMuted(){
+		errorsTarget() = previous;
+	}
+};
+
+/// Length of string
+inline int length(const char *str){
+	int l = 0;
+	while (str[l])
+		l ++;
+	return l;
+}
+
+/// sanitizes word (makes it uppercase, removes non alphabets)
+inline void sanitize(char* str){
+	if (str == nullptr)
+		return;
+	int len = length(str);
+	// first make it all uppercase
+	for (int i = 0; i < len; i ++){
+		if (str[i] >= 'a' && str[i] <= 'z')
+			str[i] -= 32;
+	}
+	// now remove non alphabets
+	int i = 0, shift = 0;
+	while (i + shift < len){
+		if (str[i + shift] >= 'A' && str[i + shift] <= 'Z'){
+			str[i] = str[i + shift];
+			i ++;
+		}else{
+			shift ++;
+		}
+	}
+	str[i] = 0;
+}
+#endif
+
+#endif